@@ -51,3 +51,141 @@ black_attacking(const position_t *pos, uint8 sq)
 		return true;
 	return false;
 }
+
+///////////////////////////////
+// determines if the specified side is attacking the given square,
+// with the provided occupancy standing in for the position's own.
+// pieces missing from the occupancy don't attack. this lets the move
+// generator test a square with the king lifted off the board, or
+// with both pawns of an en passant capture removed.
+///////////////////////////////
+bool
+attacked_through(const position_t *pos, uint8 sq, uint8 side, bitboard_t occ)
+{
+	bitboard_t pawnAttacks = side == WHITE ? BlackPawnAttacks(sq) : WhitePawnAttacks(sq);
+
+	if (pawnAttacks & Pawns(side) & occ)
+		return true;
+	if (KnightMoves(sq) & Knights(side) & occ)
+		return true;
+	if (KingMoves(sq) & Kings(side))
+		return true;
+	if (BishopAttacks(sq, occ) & (Bishops(side) | Queens(side)) & occ)
+		return true;
+	if (RookAttacks(sq, occ) & (Rooks(side) | Queens(side)) & occ)
+		return true;
+	return false;
+}
+
+///////////////////////////////
+// returns a map of the pieces of the side to move which are pinned
+// to their own king. sliders of the opponent that would attack the
+// king if only the opponent's pieces were on the board are snipers,
+// and a lone friendly piece between one and the king is pinned.
+///////////////////////////////
+bitboard_t
+pinned_pieces(const position_t *pos, uint8 stm)
+{
+	uint8 opp = stm ^ 1;
+	uint8 ksq = KingSq(stm);
+	bitboard_t pinned = 0, between;
+	bitboard_t snipers =
+			(RookAttacks(ksq, Pieces(opp))   & (Rooks(opp)   | Queens(opp)))
+		| (BishopAttacks(ksq, Pieces(opp)) & (Bishops(opp) | Queens(opp)));
+
+	while (snipers) {
+		between = RayBetween(ksq, poplsb(snipers)) & Occupied;
+		if (between && !(between & (between - 1)) && (between & Pieces(stm)))
+			pinned |= between;
+	}
+
+	return pinned;
+}
+
+///////////////////////////////
+// static exchange evaluation: the material the side making the given
+// capture (or quiet move) can expect to win, if both sides keep
+// recapturing on the target square with their least valuable piece,
+// and either may stop when going on would lose more.
+//
+// the occupancy is updated as pieces join the exchange, and sliders
+// uncovered behind them are added from the slider tables, so x-ray
+// attackers take part in their turn. pins are ignored. the king's
+// value is so large that an illegal king recapture never pays off,
+// so it needs no special case. a promotion counts the piece promoted
+// to, but only for the move itself, not for any pawn recaptures.
+///////////////////////////////
+int
+see(const position_t *pos, move_t mv)
+{
+	uint8 to = To(mv);
+	uint8 side = PieceColor(Piece(mv));
+	bitboard_t occ = Occupied ^ Mask(From(mv));
+	bitboard_t diagonal = Bishops(WHITE) | Queens(WHITE) | Bishops(BLACK) | Queens(BLACK);
+	bitboard_t straight = Rooks(WHITE) | Queens(WHITE) | Rooks(BLACK) | Queens(BLACK);
+	bitboard_t attackers, mine, lva;
+	int gain[32], d = 0;
+	int onSquare = PieceValue(PieceType(Piece(mv)));
+	uint8 pc;
+
+	gain[0] = PieceValue(PieceType(Capture(mv)));
+	if (IsEnPassant(mv))
+		occ ^= Mask(side == WHITE ? to - 8 : to + 8);
+	if (Promote(mv)) {
+		onSquare = PieceValue(PieceType(Promote(mv)));
+		gain[0] += onSquare - PieceValue(PAWN);
+	}
+
+	attackers = (attacks_to(pos, to)
+			| (BishopAttacks(to, occ) & diagonal)
+			| (RookAttacks(to, occ) & straight)) & occ;
+
+	while (true) {
+		side ^= 1;
+		mine = attackers & Pieces(side);
+		if (!mine)
+			break;
+
+		// the least valuable attacker recaptures. gain[d] is what the
+		// side making capture d is up if the exchange stops there.
+		if ((lva = mine & Pawns(side)))        pc = PAWN;
+		else if ((lva = mine & Knights(side))) pc = KNIGHT;
+		else if ((lva = mine & Bishops(side))) pc = BISHOP;
+		else if ((lva = mine & Rooks(side)))   pc = ROOK;
+		else if ((lva = mine & Queens(side)))  pc = QUEEN;
+		else { lva = mine & Kings(side);       pc = KING; }
+
+		d++;
+		gain[d] = onSquare - gain[d - 1];
+		onSquare = PieceValue(pc);
+
+		occ ^= Mask(lsb(lva));
+		if (pc == PAWN || pc == BISHOP || pc == QUEEN)
+			attackers |= BishopAttacks(to, occ) & diagonal;
+		if (pc == ROOK || pc == QUEEN)
+			attackers |= RookAttacks(to, occ) & straight;
+		attackers &= occ;
+	}
+
+	// back up the exchange: each side either stops, or recaptures if
+	// that turns out better for it
+	for (; d > 0; d--)
+		gain[d - 1] = -Max(-gain[d - 1], gain[d]);
+
+	return gain[0];
+}
+
+///////////////////////////////
+// true if the given capture loses material. taking a piece worth at
+// least as much as the capturer never does, which spares most
+// captures the full exchange evaluation.
+///////////////////////////////
+bool
+losing_capture(const position_t *pos, move_t mv)
+{
+	if (Promote(mv))
+		return false;
+	if (PieceValue(PieceType(Capture(mv))) >= PieceValue(PieceType(Piece(mv))))
+		return false;
+	return see(pos, mv) < 0;
+}
@@ -9,13 +9,24 @@
 #include "types.h"
 #include "bitboard.h"
 
+#ifdef USE_PEXT
+#include <immintrin.h>
+#endif
+
 using namespace std;
 
 #define ENGINE_NAME    "Benthos"
 #define ENGINE_VERSION "0.1"
 #define ENGINE_AUTHOR  "Phil O. Despotos"
 
+#ifdef USE_PEXT
+#define SLIDER_BACKEND "pext"
+#else
+#define SLIDER_BACKEND "magic"
+#endif
+
 #define MAXPLY 64
+#define MAXTHREADS 64
 #define MAXGAMELENGTH 512
 #define MOVESTACKSIZE 4096
 
@@ -25,9 +36,6 @@ using namespace std;
 #define Min(a,b)   ((a) > (b) ? (b) : (a))
 
 #define Mask(x)    (mask00L[x])
-#define Mask90L(x) (mask90L[x])
-#define Mask45L(x) (mask45L[x])
-#define Mask45R(x) (mask45R[x])
 
 ///////////////////////////////
 // PIECEMAX is larger than the actual number of types of pieces, as
@@ -94,6 +102,7 @@ enum directions {
 #define Distance(a,b)   (distances[a][b])
 #define Direction(a,b)  (direction[a][b])
 #define RayBetween(a,b) (rays[a][b])
+#define LineThrough(a,b) (lines[a][b])
 
 ///////////////////////////////
 // moves are represented with a 32-bit int, encoded as follows:
@@ -167,21 +176,21 @@ enum directions {
 #define KingSq(stm)  (pos->kingSq[stm])
 
 #define Occupied     (pos->occupied)
-#define Occupied90L  (pos->occupied90L)
-#define Occupied45L  (pos->occupied45L)
-#define Occupied45R  (pos->occupied45R)
 #define PieceOn(sq)  (pos->pieces[sq])
 
-#define Stm(ply)             (states[ply].stm)
-#define EpSquare(ply)        (states[ply].epSquare)
-#define Castling(ply)        (states[ply].castling)
-#define HalfmoveClock(ply)   (states[ply].halfmoveClock)
-#define Material(ply, stm)   (states[ply].material[stm])
-#define PawnCount(ply, stm)  (states[ply].pawnCount[stm])
-#define MinorCount(ply, stm) (states[ply].minorCount[stm])
-#define MajorCount(ply, stm) (states[ply].majorCount[stm])
-#define HashKey(ply)         (states[ply].hashKey)
-#define PawnHashKey(stm)     (states[ply].pawnHashKey)
+#define State(ply)           (pos->states[ply])
+#define Stm(ply)             (State(ply).stm)
+#define EpSquare(ply)        (State(ply).epSquare)
+#define Castling(ply)        (State(ply).castling)
+#define HalfmoveClock(ply)   (State(ply).halfmoveClock)
+#define Material(ply, stm)   (State(ply).material[stm])
+#define PawnCount(ply, stm)  (State(ply).pawnCount[stm])
+#define MinorCount(ply, stm) (State(ply).minorCount[stm])
+#define MajorCount(ply, stm) (State(ply).majorCount[stm])
+#define HashKey(ply)         (State(ply).hashKey)
+#define PawnHashKey(ply)     (State(ply).pawnHashKey)
+#define PsqScore(ply, phase) (State(ply).psq[phase])
+#define Accumulator(ply)     (pos->accumulators[ply])
 
 ///////////////////////////////
 // bitboard move map macros. sliders require position_t *pos in scope
@@ -190,13 +199,30 @@ enum directions {
 #define BlackPawnAttacks(sq) (blackPawnAttacks[sq])
 #define KnightMoves(sq)      (knightMoves[sq])
 #define KingMoves(sq)        (kingMoves[sq])
-#define RookMoves(sq)        (RankMoves(sq) | FileMoves(sq))
-#define BishopMoves(sq)      (DiagMovesA8H1(sq) | DiagMovesA1H8(sq))
+#define FrontSpan(c, sq)     (frontSpans[c][sq])
+#define AttackSpan(c, sq)    (attackSpans[c][sq])
+#define PassedMask(c, sq)    (passedPawnMasks[c][sq])
+#define RookMoves(sq)        (RookAttacks(sq, Occupied))
+#define BishopMoves(sq)      (BishopAttacks(sq, Occupied))
 #define QueenMoves(sq)       (RookMoves(sq) | BishopMoves(sq))
-#define RankMoves(sq)        (rookMoves00L[sq][(Occupied >> (FirstInRank(sq) + 1) & 0x3f)])
-#define FileMoves(sq)        (rookMoves90L[sq][(Occupied90L >> shift90L[sq]) & 0x3f])
-#define DiagMovesA8H1(sq)    (bishopMoves45L[sq][(Occupied45L >> shift45L[sq]) & 0x3f])
-#define DiagMovesA1H8(sq)    (bishopMoves45R[sq][(Occupied45R >> shift45R[sq]) & 0x3f])
+
+///////////////////////////////
+// magic bitboard lookups for sliders, given an arbitrary occupancy.
+// the relevant occupancy bits are multiplied by the square's magic,
+// and the top bits of the product index the square's slice of the
+// shared attack table.
+//
+// when built with USE_PEXT (make ARCH=bmi2), the relevant bits are
+// instead gathered directly with the bmi2 pext instruction. the index
+// range per square is identical, so both share the same table layout.
+///////////////////////////////
+#ifdef USE_PEXT
+#define MagicIndex(m, occ)     (_pext_u64((occ), (m).mask))
+#else
+#define MagicIndex(m, occ)     ((((occ) & (m).mask) * (m).magic) >> (m).shift)
+#endif
+#define RookAttacks(sq, occ)   (rookMagics[sq].attacks[MagicIndex(rookMagics[sq], occ)])
+#define BishopAttacks(sq, occ) (bishopMagics[sq].attacks[MagicIndex(bishopMagics[sq], occ)])
 
 #define WhiteAttacking(sq) (white_attacking(pos, (sq)))
 #define BlackAttacking(sq) (black_attacking(pos, (sq)))
@@ -235,6 +261,13 @@ enum directions {
 #define ZobristEp(sq)       (zobristEp[sq])
 #define ZobristStm          (zobristStm)
 
+///////////////////////////////
+// piece-square table access. the tables are signed like pieceValues,
+// so the sums kept in the state are from white's point of view.
+///////////////////////////////
+enum phases { MIDGAME, ENDGAME };
+#define Psq(phase, pc, sq)  (psqTables[phase][pc][sq])
+
 ///////////////////////////////
 // constants for the hash table entries
 ///////////////////////////////
@@ -243,28 +276,46 @@ enum directions {
 #define BETA  0x2
 #define EXACT 0x4
 
+// the entries of a bucket fill one 64 byte cache line
+#define HASH_BUCKET_SIZE  8
+#define HASH_BUCKET_ALIGN 64
+
+// the flags of an entry hold the bound type in the low three bits and
+// the age of the search that stored it in the upper five.
+#define HASH_BOUND_MASK   0x7
+#define HASH_AGE_SHIFT    3
+#define HASH_AGE_MASK     0x1f
+#define HashBound(e)      ((e)->flags & HASH_BOUND_MASK)
+#define HashAge(e)        ((e)->flags >> HASH_AGE_SHIFT)
+#define HashFlags(t, age) ((t) | (((age) & HASH_AGE_MASK) << HASH_AGE_SHIFT))
+
+// the upper 16 bits of the key are kept to check an entry; the low bits
+// already picked the bucket.
+#define HashCheck(key)    ((uint16)((key) >> 48))
+
+// moves are stored in 16 bits: the squares and the promotion type.
+// the hash move is matched against the legal move list in this form.
+#define HashMove(mv)      (((mv) & 0xfff) | (PieceType(Promote(mv)) << 12))
+
 ///////////////////////////////
 // search status.
 ///////////////////////////////
 enum search_status { IDLE, THINKING, ABORTED };
 
 ///////////////////////////////
-// the position structure is kept minimal, as it must be updated
-// by both make_move and unmake_move. anything which can simply be
-// "rolled back" should probably be kept in the state stack.
+// per-square data for the magic bitboard slider lookups. the attack
+// tables are shared by all squares, each getting a slice exactly as
+// large as its number of relevant occupancies.
 ///////////////////////////////
-typedef struct position {
-	bitboard_t occupied, occupied90L, occupied45L, occupied45R;
-	bitboard_t occ[2];
-	bitboard_t pawns[2];
-	bitboard_t knights[2];
-	bitboard_t bishops[2];
-	bitboard_t rooks[2];
-	bitboard_t queens[2];
-	bitboard_t kings[2];
-	square_t   kingSq[2];
-	piece_t    pieces[64];
-} position_t;
+#define ROOK_ATTACK_TABLE_SIZE   102400
+#define BISHOP_ATTACK_TABLE_SIZE 5248
+
+typedef struct magic {
+	bitboard_t  mask;
+	bitboard_t  magic;
+	bitboard_t *attacks;
+	int         shift;
+} magic_t;
 
 ///////////////////////////////
 // defines the various state-related qualities of the board at a
@@ -276,6 +327,7 @@ typedef struct state {
 	uint8     castling;
 	uint8     halfmoveClock;
 	int       material[2];
+	int       psq[2];            // piece-square sums, by phase
 	uint8     pawnCount[2];
 	uint8     minorCount[2];
 	uint8     majorCount[2];
@@ -283,6 +335,38 @@ typedef struct state {
 	hashkey_t pawnHashKey;
 } state_t;
 
+///////////////////////////////
+// the hidden layer of the network, for both sides, as of a ply. see
+// nnue.h.
+///////////////////////////////
+#define NNUE_HIDDEN 256
+
+typedef struct accumulator {
+	int16 values[2][NNUE_HIDDEN];
+} accumulator_t;
+
+///////////////////////////////
+// the board itself is kept minimal, as it must be updated by both
+// make_move and unmake_move. anything which can simply be "rolled
+// back" should probably be kept in the state stack, which the
+// position carries along, so that a copy of a position can be
+// searched independently of the original.
+///////////////////////////////
+typedef struct position {
+	bitboard_t occupied;
+	bitboard_t occ[2];
+	bitboard_t pawns[2];
+	bitboard_t knights[2];
+	bitboard_t bishops[2];
+	bitboard_t rooks[2];
+	bitboard_t queens[2];
+	bitboard_t kings[2];
+	square_t   kingSq[2];
+	piece_t    pieces[64];
+	state_t    states[MAXPLY];
+	accumulator_t accumulators[MAXPLY]; // only kept up with a network loaded
+} position_t;
+
 ///////////////////////////////
 // used for easy checking of the draw by repetition rule.
 // maybe more if i can find a use for it.
@@ -302,6 +386,55 @@ typedef struct scored_move {
 	int score;
 } scored_move_t;
 
+///////////////////////////////
+// the staged move picker of a node. see picker.cpp.
+///////////////////////////////
+enum picker_stages {
+	PICK_HASH, PICK_GEN_CAPTURES, PICK_GOOD_CAPTURES, PICK_KILLERS,
+	PICK_GEN_QUIETS, PICK_QUIETS, PICK_BAD_CAPTURES,
+	PICK_HASH_EVASION, PICK_GEN_EVASIONS, PICK_EVASIONS,
+	PICK_GEN_QCAPTURES, PICK_QCAPTURES,
+	PICK_DONE
+};
+
+typedef struct move_picker {
+	int            stage;
+	int            ply;
+	move_t         hashMove;
+	move_t         killers[2];
+	int            nextKiller;
+	const int    (*historyScores)[64];         // the side to move's
+	scored_move_t *cur, *end;                  // what's left of the current stage
+	scored_move_t *captures, *capturesEnd;
+	scored_move_t *quiets, *quietsEnd;
+	scored_move_t *badCaptures, *badEnd;
+	scored_move_t *top;                        // the first free slot on the move stack
+} move_picker_t;
+
+///////////////////////////////
+// hash table, pawn hash table and evaluation usage for the current
+// search, reported after each move. it's counted in the search info,
+// next to the nodes.
+///////////////////////////////
+typedef struct hash_stats {
+	uint64 probes;
+	uint64 hits;
+	uint64 stores;
+	uint64 replaced;      // stores that overwrote another position
+	uint64 staleReplaced; // ... left over from an earlier search
+} hash_stats_t;
+
+typedef struct phash_stats {
+	uint64 probes;
+	uint64 hits;
+} phash_stats_t;
+
+typedef struct eval_stats {
+	uint64 calls;
+	uint64 lazyExits;            // with the expensive terms skipped
+	uint64 cacheHits;            // found in the eval cache
+} eval_stats_t;
+
 ///////////////////////////////
 // stores information that needs to be reinitialized before each
 // search, such as the list of hash keys along the current line
@@ -319,11 +452,11 @@ typedef struct search_info {
 	bool    inf;
 	int     depthLimit;
 	uint64  nodeLimit;
-	clock_t startTime;
-	clock_t endTime;
+	uint64  startTime;              // wall clock, in milliseconds
+	uint64  endTime;
 
 	// root move list
-	scored_move_t rootMoves[64];    // maybe oversized, but just in case.
+	scored_move_t rootMoves[256];   // the most legal moves known of a position is 218
 	uint8         rootMoveCount;
 	uint8         curRootMoveNum;
 
@@ -332,6 +465,39 @@ typedef struct search_info {
 	int       bestRootScore;
 	int       matesFound;           // search is stopped early if this >= 2
 
+	// the last fully searched iteration, for picking between threads
+	int       completedDepth;
+	move_t    completedMove;
+	bool      helper;               // a lazy smp helper, not the main thread
+
+	// quiet move ordering: two killer moves per ply, and a history
+	// score for each quiet move by side, from and to square
+	move_t    killers[MAXPLY][2];
+	int       historyScores[2][64][64];
+
+	// move ordering statistics
+	uint64    cutoffs;
+	uint64    firstMoveCutoffs;
+
+	// re-searches: root iterations outside of the aspiration window,
+	// and null window searches that have to be done again in full
+	int       failHighs;
+	int       failLows;
+	uint64    pvsResearches;
+
+	// fail highs after a null move
+	uint64    nullCutoffs;
+
+	// late moves searched to a reduced depth, and the ones of those
+	// that failed high and were searched again
+	uint64    lmrReductions;
+	uint64    lmrResearches;
+
+	// table and evaluation usage
+	hash_stats_t  hashStats;
+	phash_stats_t pawnHashStats;
+	eval_stats_t  evalStats;
+
 	// for threefold repetition
 	int       keyidx;               // the number of keys in keylog[] _prior_ to the search
 	                                // thus, keyidx+ply = where to store the key for a new node
@@ -339,43 +505,82 @@ typedef struct search_info {
 } search_info_t;
 
 ///////////////////////////////
-// an entry in the hash table. this could be further condensed, as
-// some other engines do. perhaps in the future. TODO
-///////////////////////////////
-typedef struct hash_entry {
-	hashkey_t key;
-	int       depth;
-	int       type;
-	int       score;
-	move_t    move;
-	int       seq;
+// everything a search needs of its own: the position, with its state
+// stack, the game history leading up to it, and the search info. only
+// the hash table is shared, so separate contexts can search at once.
+// the lazy smp helpers each search a context copied from the main one.
+///////////////////////////////
+typedef struct search_context {
+	position_t             pos;
+	search_info_t          info;
+	history_t              history[MAXGAMELENGTH];
+	int                    gamePly;
+
+	// lazy smp
+	int                    threads;
+	struct helper_thread  *helpers;
+	int                    helperCount;
+	volatile bool          stopHelpers;
+	struct search_context *parent;     // for a helper, the context it helps
+} search_context_t;
+
+///////////////////////////////
+// an entry in the hash table, packed into 8 bytes. the table is made
+// of buckets of these, so that a probe only touches one cache line.
+// entries are only ever read and written whole, through word, so that
+// threads sharing the table can't see one half written.
+///////////////////////////////
+typedef union hash_entry {
+	struct {
+		uint16    check;
+		uint16    move;
+		int16     score;
+		uint8     depth;
+		uint8     flags;
+	};
+	uint64    word;
 } hash_entry_t;
 
+typedef struct hash_bucket {
+	hash_entry_t entries[HASH_BUCKET_SIZE];
+} hash_bucket_t;
+
 ///////////////////////////////
-// an entry in the pawn hash table. this needs to be expanded. TODO
+// an entry in the pawn hash table: everything the pawn structure
+// alone decides, for one pawn configuration. the check word is the
+// key xored with the rest of the entry, so that an entry torn by two
+// threads storing at once is caught. 64 bytes, a cache line.
 ///////////////////////////////
 typedef struct phash_entry {
-	hashkey_t key;
-	int       score;
+	hashkey_t  check;
+	int        score;            // from white's point of view
+	int        unused;
+	bitboard_t passed[2];        // passed pawns
+	bitboard_t weak[2];          // isolated, doubled or backward pawns
+	bitboard_t attackSpans[2];   // every square the pawns could attack
 } phash_entry_t;
 
+// int32 is a long, and would make it 72 bytes on 64-bit systems
+static_assert(sizeof(phash_entry_t) == 64, "phash_entry_t should fill one cache line");
+
 // externs
 // bitboard.cpp:
 extern bitboard_t        mask00L[64];
-extern bitboard_t        mask90L[64];
-extern bitboard_t        mask45L[64];
-extern bitboard_t        mask45R[64];
 extern int               distances[64][64];
 extern int               direction[64][64];
 extern bitboard_t        rays[64][64];
+extern bitboard_t        lines[64][64];
 extern bitboard_t        whitePawnAttacks[64];
 extern bitboard_t        blackPawnAttacks[64];
 extern bitboard_t        knightMoves[64];
 extern bitboard_t        kingMoves[64];
-extern bitboard_t        rookMoves00L[64][64];
-extern bitboard_t        rookMoves90L[64][64];
-extern bitboard_t        bishopMoves45L[64][64];
-extern bitboard_t        bishopMoves45R[64][64];
+extern bitboard_t        frontSpans[2][64];
+extern bitboard_t        attackSpans[2][64];
+extern bitboard_t        passedPawnMasks[2][64];
+extern magic_t           rookMagics[64];
+extern magic_t           bishopMagics[64];
+extern bitboard_t        rookAttackTable[ROOK_ATTACK_TABLE_SIZE];
+extern bitboard_t        bishopAttackTable[BISHOP_ATTACK_TABLE_SIZE];
 // data.cpp:
 extern const bitboard_t  fileMasks[8];
 extern const bitboard_t  rankMasks[8];
@@ -383,18 +588,16 @@ extern const char       *squareNames[65];
 extern const int         pieceValues[16];
 extern const char        fenChars[16];
 extern const char        sanChars[16];
+// eval.cpp:
+extern int               psqTables[2][16][64];
 // hash.cpp:
-extern hash_entry_t     *hashTable;
-extern int               hashMaxEntries;
-// history.cpp:
-extern history_t         history[MAXGAMELENGTH];
-extern int               currentGamePly;
-// main.cpp:
-extern position_t       *rootPosition;
-extern state_t           states[MAXPLY];
-extern int               currentPly;
-// search.cpp:
-extern search_info_t    *searchInfo;
+extern hash_bucket_t    *hashTable;
+extern uint64            hashBucketCount;
+extern uint8             hashAge;
+// nnue.cpp:
+extern bool              nnueEnabled;
+// pawns.cpp:
+extern phash_entry_t    *pawnHash;
 // ui.cpp:
 extern bool              suppressSearchStatus;
 // zobrist.cpp:
@@ -408,47 +611,78 @@ extern hashkey_t         zobristStm;
 uint64         attacks_to(const position_t *, uint8);
 bool           white_attacking(const position_t *, uint8);
 bool           black_attacking(const position_t *, uint8);
+bool           attacked_through(const position_t *, uint8, uint8, bitboard_t);
+bitboard_t     pinned_pieces(const position_t *, uint8);
+int            see(const position_t *, move_t);
+bool           losing_capture(const position_t *, move_t);
 // bitboard.cpp:
-bitboard_t     rotate90L(bitboard_t);
-bitboard_t     rotate45L(bitboard_t);
-bitboard_t     rotate45R(bitboard_t);
 void           init_bitboards(void);
 // eval.cpp:
-int            eval(const position_t *, int);
+void           init_eval(void);
+void           init_eval_cache(int);
+void           clear_eval_cache(void);
+int            eval(const position_t *, int, int, int, search_info_t *);
 // hash.cpp:
 void           init_hash(int);
 void           clear_hash();
-int            probe_hash(hashkey_t, int, int, int, move_t *);
-void           store_hash(hashkey_t, int, int, int, move_t);
+bool           read_hash(hashkey_t, hash_entry_t *);
+void           new_hash_search(void);
+int            hash_full(void);
+int            probe_hash(hashkey_t, int, int, int, move_t *, hash_stats_t *);
+void           store_hash(hashkey_t, int, int, int, move_t, hash_stats_t *);
 // history.cpp:
-void           reset_history(void);
-void           history_new_game(void);
-void           make_history_move(position_t *pos, move_t move);
+void           reset_history(search_context_t *);
+void           history_new_game(search_context_t *);
+void           make_history_move(search_context_t *, move_t);
 // make.cpp:
 void           make_move(position_t *, move_t, int);
 void           unmake_move(position_t *, move_t, int);
+void           make_null_move(position_t *, int);
+void           unmake_null_move(position_t *, int);
 // mersenne.cpp:
 uint32         genrand_int32(void);
 uint64         genrand_int64(void);
 void           init_mersenne(void);
 // movegen.cpp:
+scored_move_t *generate_moves(const position_t *, scored_move_t *, int);
 scored_move_t *generate_captures(const position_t *, scored_move_t *, int);
 scored_move_t *generate_noncaptures(const position_t *, scored_move_t *, int);
 scored_move_t *generate_evasions(const position_t *, scored_move_t *, int);
+bool           is_legal_noncapture(const position_t *, move_t, int);
+// nnue.cpp:
+bool           load_network(const char *);
+void           unload_network(void);
+void           refresh_accumulator(position_t *, int);
+void           update_accumulator(position_t *, move_t, int);
+bool           verify_accumulator(position_t *, int);
+int            nnue_eval(const position_t *, int);
+// pawns.cpp:
+void           init_pawn_hash(int);
+void           clear_pawn_hash(void);
+void           probe_pawns(const position_t *, int, phash_entry_t *, phash_stats_t *);
+// picker.cpp:
+void           init_picker(move_picker_t *, const position_t *, scored_move_t *, int, move_t, const search_info_t *);
+void           init_quiesce_picker(move_picker_t *, const position_t *, scored_move_t *, int);
+move_t         next_move(move_picker_t *, const position_t *);
 // position.cpp:
-void           clear_position(void);
-void           reset_state(int);
+void           clear_position(position_t *);
+void           reset_state(position_t *, int);
 bool           position_from_fen(position_t *, char *);
 char          *position_to_fen(const position_t *, int);
 // search.cpp:
-move_t         search(position_t *);
-void           init_search(void);
+search_context_t *new_search_context(void);
+move_t         search(search_context_t *);
+uint64         search_nodes(const search_context_t *);
+void           clear_history_scores(search_context_t *);
+void           search_stats(const search_context_t *, hash_stats_t *, phash_stats_t *, eval_stats_t *);
 // ui.cpp:
-void           ui_loop(void);
-void           parse_input_while_searching(void);
-void           report_search_info(void);
+void           ui_loop(search_context_t *);
+void           parse_input_while_searching(search_context_t *);
+void           report_search_info(search_context_t *);
+void           report_search_stats(search_context_t *);
 bool           input_available(void);
 // util.cpp:
+uint64         get_time(void);
 char          *move2str(move_t);
 move_t         str2move(const position_t *, const char *);
 char          *move2san(move_t);
@@ -456,7 +690,7 @@ move_t         san2move(const position_t *, const char *, int);
 void           print_board(const position_t *);
 void           print_bitboard(const bitboard_t);
 // zobrist.cpp:
-void           calculate_hash_keys(const position_t *, int);
+void           calculate_hash_keys(position_t *, int);
 void           init_zobrist(void);
 
 #endif // !defined(BENTHOS_H)
@@ -0,0 +1,176 @@
+#include "benthos.h"
+#include <cstring>
+
+///////////////////////////////
+// a micro-benchmark for the bit twiddling primitives in bitboard.h,
+// run as a separate program like perft. each primitive is timed in
+// isolation, both in the flavor selected at compile time and in the
+// software version, over the same set of bitboards. the sets are
+// sparse, roughly like the piece and target sets serialized by the
+// move generator's poplsb loops.
+///////////////////////////////
+
+void bench_all(void);
+void report(const char *, double, uint64, double, uint64);
+void usage(void);
+
+int         passes = 2000;
+
+#define BOARDS 4096
+
+bitboard_t  boards[BOARDS];
+
+// read through a volatile pointer, so the compiler can't hoist the
+// work out of the pass loop.
+bitboard_t * volatile boardList = boards;
+
+///////////////////////////////
+// the serializing primitives consume the whole bitboard, as the move
+// generator does.
+///////////////////////////////
+static inline int
+serialize_lsb(uint64 b)
+{
+	int sum = 0;
+	while (b)
+		sum += poplsb(b);
+	return sum;
+}
+
+static inline int
+serialize_lsb_soft(uint64 b)
+{
+	int sum = 0;
+	while (b) {
+		sum += lsb_soft(b);
+		b &= b - 1;
+	}
+	return sum;
+}
+
+static inline int
+serialize_msb(uint64 b)
+{
+	int sum = 0;
+	while (b)
+		sum += popmsb(b);
+	return sum;
+}
+
+static inline int
+serialize_msb_soft(uint64 b)
+{
+	int sum = 0;
+	uint8 sq;
+	while (b) {
+		sq = msb_soft(b);
+		b &= ~(ULL(1) << sq);
+		sum += sq;
+	}
+	return sum;
+}
+
+///////////////////////////////
+// times one flavor of a primitive over all of the boards. the sum of
+// the results goes into checksum so that the work can't be optimized
+// away, and doubles as a correctness check between the flavors. this
+// is a macro rather than a function taking a function pointer, so the
+// primitive is inlined into the loop just as it is in the engine.
+///////////////////////////////
+#define TimePrimitive(func, secs, checksum)                             \
+	do {                                                                  \
+		clock_t start_time = clock();                                       \
+		uint64 sum = 0;                                                     \
+		for (int p = 0; p < passes; p++) {                                  \
+			const bitboard_t *bbs = boardList;                                \
+			for (int i = 0; i < BOARDS; i++)                                  \
+				sum += func(bbs[i]);                                            \
+		}                                                                   \
+		checksum = sum;                                                     \
+		secs = ((double)clock() - (double)start_time) / CLOCKS_PER_SEC;     \
+	} while (0)
+
+#define BenchPrimitive(name, fast, soft)                                \
+	do {                                                                  \
+		TimePrimitive(fast, fastTime, fastSum);                             \
+		TimePrimitive(soft, softTime, softSum);                             \
+		report(name, fastTime, fastSum, softTime, softSum);                 \
+	} while (0)
+
+int
+main(int argc, char *argv[])
+{
+	init_mersenne();
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-help"))
+			usage();
+		else if (!strcmp(argv[i], "-passes")) {
+			if (argc <= i + 1)
+				usage();
+			passes = atoi(argv[++i]);
+		} else
+			usage();
+	}
+
+	bench_all();
+
+	return 0;
+}
+
+///////////////////////////////
+// prints a line of the results table.
+///////////////////////////////
+void
+report(const char *name, double fast, uint64 fastsum, double soft, uint64 softsum)
+{
+	double calls = (double)passes * BOARDS;
+
+	printf("%-8s %10.2f %10.2f %7.2fx", name,
+			fast * 1e9 / calls, soft * 1e9 / calls, fast > 0 ? soft / fast : 0);
+	if (fastsum != softsum)
+		printf(" [mismatch: %llu != %llu]", fastsum, softsum);
+	printf("\n");
+}
+
+void
+bench_all(void)
+{
+	uint64 fastSum, softSum;
+	double fastTime, softTime;
+
+	// none of the primitives are required to handle zero
+	for (int i = 0; i < BOARDS; i++) {
+		do
+			boards[i] = genrand_int64() & genrand_int64() & genrand_int64();
+		while (!boards[i]);
+	}
+
+#ifdef USE_BUILTIN_POPCNT
+	printf("popcnt: builtin, ");
+#else
+	printf("popcnt: software, ");
+#endif
+#ifdef USE_BUILTIN_BITSCAN
+	printf("bitscans: builtin\n");
+#else
+	printf("bitscans: software\n");
+#endif
+	printf("%d boards x %d passes, ns per call:\n\n", BOARDS, passes);
+	printf("%-8s %10s %10s %8s\n", "", "selected", "software", "speedup");
+
+	BenchPrimitive("popcnt", popcnt, popcnt_soft);
+	BenchPrimitive("lsb",    lsb,    lsb_soft);
+	BenchPrimitive("msb",    msb,    msb_soft);
+	BenchPrimitive("poplsb", serialize_lsb, serialize_lsb_soft);
+	BenchPrimitive("popmsb", serialize_msb, serialize_msb_soft);
+}
+
+void
+usage(void)
+{
+	printf("usage: bitbench [-help] [-passes <n>]\n");
+	printf("       -help  : prints this.\n");
+	printf("       -passes: number of passes over the boards per primitive. (default: 2000)\n");
+	exit(1);
+}
@@ -5,62 +5,25 @@
 ///////////////////////////////
 
 bitboard_t mask00L[64];
-bitboard_t mask90L[64];
-bitboard_t mask45L[64];
-bitboard_t mask45R[64];
 
 int        distances[64][64];
 int        direction[64][64];
 bitboard_t rays[64][64];
+bitboard_t lines[64][64];
 
 bitboard_t whitePawnAttacks[64];
 bitboard_t blackPawnAttacks[64];
 bitboard_t knightMoves[64];
 bitboard_t kingMoves[64];
-bitboard_t rookMoves00L[64][64];
-bitboard_t rookMoves90L[64][64];
-bitboard_t bishopMoves45L[64][64];
-bitboard_t bishopMoves45R[64][64];
 
-///////////////////////////////
-// returns the provided bitboard rotated using the provided map
-///////////////////////////////
-static inline bitboard_t
-rotate(const bitboard_t bb, const uint8 map[])
-{
-	bitboard_t rot = 0;
-	for (int i = 0; i < 64; i++)
-		if (bb & Mask(i))
-			rot |= ULL(1) << map[i];
-	return rot;
-}
+bitboard_t frontSpans[2][64];
+bitboard_t attackSpans[2][64];
+bitboard_t passedPawnMasks[2][64];
 
-///////////////////////////////
-// returns the provided bitboard rotated 90 degrees to the left
-///////////////////////////////
-bitboard_t
-rotate90L(bitboard_t bb)
-{
-	return rotate(bb, rot90L);
-}
-
-///////////////////////////////
-// returns the provided bitboard rotated 45 degrees to the left
-///////////////////////////////
-bitboard_t
-rotate45L(bitboard_t bb)
-{
-	return rotate(bb, rot45L);
-}
-
-///////////////////////////////
-// returns the provided bitboard rotated 45 degrees to the right
-///////////////////////////////
-bitboard_t
-rotate45R(bitboard_t bb)
-{
-	return rotate(bb, rot45R);
-}
+magic_t    rookMagics[64];
+magic_t    bishopMagics[64];
+bitboard_t rookAttackTable[ROOK_ATTACK_TABLE_SIZE];
+bitboard_t bishopAttackTable[BISHOP_ATTACK_TABLE_SIZE];
 
 ///////////////////////////////
 // fills in the array specifying the distance between two squares
@@ -101,102 +64,110 @@ init_nonslide_map(bitboard_t maps[], int deltas[], int cnt)
 }
 
 ///////////////////////////////
-// helper function for determining the mobility of a sliding
-// piece along a rank, given the contents of the rank
+// returns the squares reachable by a sliding piece on src moving
+// along the provided directions, stopping at (and including) the
+// first occupied square in each direction.
 ///////////////////////////////
-static int
-calc_slide(int src, int contents)
+static bitboard_t
+slide_attacks(int src, bitboard_t occ, const int deltas[])
 {
-	int sq = src;
-	int slide = 0;
-	int mask;
-
-	while (++sq < 8) {
-		mask = 1 << sq;
-		slide |= mask;
-		if (contents & mask)
-			break;
-	}
-
-	sq = src;
-	while (--sq >= 0) {
-		mask = 1 << sq;
-		slide |= mask;
-		if (contents & mask)
-			break;
+	int sq, lastsq;
+	bitboard_t map = 0;
+
+	for (int i = 0; i < 4; i++) {
+		lastsq = src;
+		sq = src + deltas[i];
+		while (sq >= 0 && sq <= 63 && Distance(sq, lastsq) == 1) {
+			map |= Mask(sq);
+			if (occ & Mask(sq))
+				break;
+			lastsq = sq;
+			sq += deltas[i];
+		}
 	}
 
-	return slide;
+	return map;
 }
 
-// masks for clearing unnecessary bits on short diagonals.
-static int diag_masks45L[64] = {
-	 0x1,  0x3,  0x7,  0xf, 0x1f, 0x3f, 0x7f, 0xff,
-	 0x3,  0x7,  0xf, 0x1f, 0x3f, 0x7f, 0xff, 0x3f,
-	 0x7,  0xf, 0x1f, 0x3f, 0x7f, 0xff, 0x7f, 0x3f,
-	 0xf, 0x1f, 0x3f, 0x7f, 0xff, 0x7f, 0x3f, 0x1f,
-	0x1f, 0x3f, 0x7f, 0xff, 0x7f, 0x3f, 0x1f,  0xf,
-	0x3f, 0x7f, 0xff, 0x7f, 0x3f, 0x1f,  0xf,  0x7,
-	0x7f, 0xff, 0x7f, 0x3f, 0x1f,  0xf,  0x7,  0x3,
-	0xff, 0x7f, 0x3f, 0x1f,  0xf,  0x7,  0x3,  0x1,
-};
-static int diag_masks45R[64] = {
-	0xff, 0x7f, 0x3f, 0x1f,  0xf,  0x7,  0x3,  0x1,
-	0x7f, 0xff, 0x7f, 0x3f, 0x1f,  0xf,  0x7,  0x3,
-	0x3f, 0x7f, 0xff, 0x7f, 0x3f, 0x1f,  0xf,  0x7,
-	0x1f, 0x3f, 0x7f, 0xff, 0x7f, 0x3f, 0x1f,  0xf,
-	 0xf, 0x1f, 0x3f, 0x7f, 0xff, 0x7f, 0x3f, 0x1f,
-	 0x7,  0xf, 0x1f, 0x3f, 0x7f, 0xff, 0x7f, 0x3f,
-	 0x3,  0x7,  0xf, 0x1f, 0x3f, 0x7f, 0xff, 0x7f,
-	 0x1,  0x3,  0x7,  0xf, 0x1f, 0x3f, 0x7f, 0xff,
-};
+// scratch space for the slider initialization: every relevant
+// occupancy of a square, and the attack set for each of them.
+static bitboard_t occupancy[4096], reference[4096];
 
+#ifndef USE_PEXT
 ///////////////////////////////
-// initializes the sliding piece attack maps.
-//
-// this method of initialization was taken from King's Out
-// by Brad Nrnberg; it's amazingly legible compared to most.
+// tries random sparse candidates until one maps every occupancy of
+// the square into its slice of the attack table without a collision
+// between different attack sets. the epoch array marks which slots
+// were filled by the current attempt, so the slice needn't be cleared.
 ///////////////////////////////
 static void
-init_slide_maps(void)
+find_magic(magic_t *m, bitboard_t attacks[], int size)
 {
-	int sq, contents, middle;
-	int src00L, src90L, src45L, src45R;
-	bitboard_t map00L, map90L, map45L, map45R;
-
-	for (sq = 0; sq < 64; sq++) {
-		for (contents = 0; contents < 64; contents++) {
-			// shift the contents into the middle
-			middle = contents << 1;
-
-			// find the source position in the rank
-			src00L = sq - FirstInRank(sq);
-			src90L = rot90L[sq] - (shift90L[sq] - 1);
-			src45L = rot45L[sq] - (shift45L[sq] - 1);
-			src45R = rot45R[sq] - (shift45R[sq] - 1);
-
-			// determine slide mobility
-			map00L = (bitboard_t)calc_slide(src00L, middle);
-			map90L = (bitboard_t)calc_slide(src90L, middle);
-			map45L = (bitboard_t)calc_slide(src45L, middle);
-			map45R = (bitboard_t)calc_slide(src45R, middle);
-
-			// remove extra bits from short diagonals
-			map45L &= diag_masks45L[sq];
-			map45R &= diag_masks45R[sq];
-
-			// shift the map into place on the full bitboard
-			map00L <<= FirstInRank(sq);
-			map90L <<= shift90L[sq] - 1;
-			map45L <<= shift45L[sq] - 1;
-			map45R <<= shift45R[sq] - 1;
-
-			// store, rotating the board back to normal where needed
-			rookMoves00L[sq][contents]   = map00L;
-			rookMoves90L[sq][contents]   = rotate(map90L, unrot90L);
-			bishopMoves45L[sq][contents] = rotate(map45L, unrot45L);
-			bishopMoves45R[sq][contents] = rotate(map45R, unrot45R);
+	static int epoch[4096], attempt = 0;
+	int i, idx;
+
+	do {
+		do
+			m->magic = genrand_int64() & genrand_int64() & genrand_int64();
+		while (popcnt((m->mask * m->magic) >> 56) < 6);
+
+		attempt++;
+		for (i = 0; i < size; i++) {
+			idx = (int)MagicIndex(*m, occupancy[i]);
+			if (epoch[idx] < attempt) {
+				epoch[idx] = attempt;
+				attacks[idx] = reference[i];
+			} else if (attacks[idx] != reference[i])
+				break;
 		}
+	} while (i < size);
+}
+#endif
+
+///////////////////////////////
+// sets up the magic lookup for every square and fills in the shared
+// ("fancy") attack table for one type of slider.
+//
+// the relevant occupancy mask excludes the board edges in each
+// direction, as a piece on the edge can't block anything. every subset
+// of the mask is enumerated with the carry-rippler trick before the
+// magic is searched for. with USE_PEXT the index is collision-free by
+// construction, so the table is simply filled in.
+///////////////////////////////
+static void
+init_magics(magic_t magics[], bitboard_t table[], const int deltas[])
+{
+	int size;
+	bitboard_t edges, subset;
+	bitboard_t *attacks = table;
+
+	for (int sq = 0; sq < 64; sq++) {
+		magic_t *m = &magics[sq];
+
+		edges = ((RankMask(RANK1) | RankMask(RANK8)) & ~RankMask(Rank(sq)))
+		      | ((FileMask(FILEA) | FileMask(FILEH)) & ~FileMask(File(sq)));
+		m->mask    = slide_attacks(sq, 0, deltas) & ~edges;
+		m->shift   = 64 - popcnt(m->mask);
+		m->attacks = attacks;
+
+		size = 0;
+		subset = 0;
+		do {
+			occupancy[size] = subset;
+			reference[size] = slide_attacks(sq, subset, deltas);
+			size++;
+			subset = (subset - m->mask) & m->mask;
+		} while (subset);
+
+#ifdef USE_PEXT
+		m->magic = 0;
+		for (int i = 0; i < size; i++)
+			attacks[MagicIndex(*m, occupancy[i])] = reference[i];
+#else
+		find_magic(m, attacks, size);
+#endif
+
+		attacks += size;
 	}
 }
 
@@ -264,6 +235,62 @@ init_rays(void)
 			RayBetween(src, dest) = mask;
 		}
 	}
+
+	// fills in the full line through two squares, from edge to edge.
+	// both squares are included.
+	for (src = 0; src < 64; src++) {
+		for (dest = 0; dest < 64; dest++) {
+			dir = Direction(src, dest);
+			if (!dir) {
+				LineThrough(src, dest) = 0;
+				continue;
+			}
+			mask = Mask(src);
+			for (sq = src; sq + dir >= 0 && sq + dir <= 63 && Distance(sq, sq + dir) == 1; sq += dir)
+				mask |= Mask(sq + dir);
+			for (sq = src; sq - dir >= 0 && sq - dir <= 63 && Distance(sq, sq - dir) == 1; sq -= dir)
+				mask |= Mask(sq - dir);
+			LineThrough(src, dest) = mask;
+		}
+	}
+}
+
+///////////////////////////////
+// fills in the masks for pawn structure evaluation, for a pawn of
+// either color on each square:
+//   front span:  the squares ahead of it on its own file
+//   attack span: the squares it could ever attack as it advances,
+//                ahead of it on the adjacent files
+//   passed mask: both together; a pawn with no enemy pawns there
+//                is passed
+///////////////////////////////
+static void
+init_pawn_masks(void)
+{
+	bitboard_t adjacent;
+
+	for (int sq = 0; sq < 64; sq++) {
+		adjacent = 0;
+		if (File(sq) != FILEA)
+			adjacent |= FileMask(File(sq) - 1);
+		if (File(sq) != FILEH)
+			adjacent |= FileMask(File(sq) + 1);
+
+		frontSpans[WHITE][sq] = 0;
+		frontSpans[BLACK][sq] = 0;
+		for (int r = Rank(sq) + 1; r <= RANK8; r++)
+			frontSpans[WHITE][sq] |= FileMask(File(sq)) & RankMask(r);
+		for (int r = Rank(sq) - 1; r >= RANK1; r--)
+			frontSpans[BLACK][sq] |= FileMask(File(sq)) & RankMask(r);
+
+		for (int c = WHITE; c <= BLACK; c++) {
+			attackSpans[c][sq] = 0;
+			for (int r = RANK1; r <= RANK8; r++)
+				if (frontSpans[c][sq] & RankMask(r))
+					attackSpans[c][sq] |= adjacent & RankMask(r);
+			passedPawnMasks[c][sq] = frontSpans[c][sq] | attackSpans[c][sq];
+		}
+	}
 }
 
 ///////////////////////////////
@@ -276,14 +303,12 @@ init_bitboards(void)
   int bpawn_delta[]  = { -7, -9 };
   int knight_delta[] = { -17, -15, -10, -6, 6, 10, 15, 17 };
   int king_delta[]   = {  -9,  -8,  -7, -1, 1,  7,  8,  9 };
+  int rook_delta[]   = {  -8,  -1,   1,  8 };
+  int bishop_delta[] = {  -9,  -7,   7,  9 };
 
-	// fill in the single bit mask arrays
-	for (int i = 0; i < 64; i++) {
+	// fill in the single bit mask array
+	for (int i = 0; i < 64; i++)
 		mask00L[i] = ULL(1) << i;
-		mask90L[i] = ULL(1) << rot90L[i];
-		mask45L[i] = ULL(1) << rot45L[i];
-		mask45R[i] = ULL(1) << rot45R[i];
-	}
 
 	// fills in the distance array
 	init_distance();
@@ -294,9 +319,13 @@ init_bitboards(void)
 	init_nonslide_map(knightMoves,      knight_delta, 8);
 	init_nonslide_map(kingMoves,        king_delta,   8);
 
-	// generate sliding attack maps
-	init_slide_maps();
+	// generate sliding attack maps. this uses the mersenne twister,
+	// so init_mersenne() must be called first.
+	init_magics(rookMagics,   rookAttackTable,   rook_delta);
+	init_magics(bishopMagics, bishopAttackTable, bishop_delta);
 
 	// fills in the directional relation and "ray between" arrays
 	init_rays();
+
+	init_pawn_masks();
 }
@@ -1,5 +1,6 @@
 #include "benthos.h"
 
+#include <cstring>
 #include <fstream>
 #include <vector>
 
@@ -12,10 +13,10 @@ void get_contents(void);
 void run_tests(void);
 void usage(void);
 
-position_t *rootPosition;
-state_t     states[MAXPLY];
+search_context_t *context;
 
 int             moveTime = 0;
+int             depthLimit = 0;
 char           *epdFilename = NULL;
 vector<string>  positions;
 vector<string>  epdIds;
@@ -24,14 +25,14 @@ vector<move_t>  expectedMoves;
 int
 main(int argc, char *argv[])
 {
-	position_t *pos = (position_t *)malloc(sizeof(position_t));
-	rootPosition = pos;
-
-	init_bitboards();
 	init_mersenne();
+	init_bitboards();
 	init_zobrist();
+	init_eval();
 	init_hash(33554432);
-	init_search();
+	init_pawn_hash(2097152);
+	init_eval_cache(4194304);
+	context = new_search_context();
 
 	for (int i = 1; i < argc; i++) {
 		if (!strcmp(argv[i], "-help"))
@@ -40,10 +41,25 @@ main(int argc, char *argv[])
 			if (argc < i + 1)
 				usage();
 			moveTime = atoi(argv[++i]) * 1000;
+		} else if (!strcmp(argv[i], "-depth")) {
+			if (argc < i + 1)
+				usage();
+			depthLimit = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-threads")) {
+			if (argc < i + 1)
+				usage();
+			context->threads = atoi(argv[++i]);
+			if (context->threads < 1 || context->threads > MAXTHREADS)
+				usage();
 		} else if (!strcmp(argv[i], "-file")) {
 			if (argc < i + 1)
 				usage();
 			epdFilename = argv[++i];
+		} else if (!strcmp(argv[i], "-net")) {
+			if (argc < i + 1)
+				usage();
+			if (!load_network(argv[++i]))
+				exit(1);
 		} else
 			usage();
 	}
@@ -110,8 +126,8 @@ get_contents(void)
 		trim = strlen(buf) - strlen(bmstr);
 		buf[trim] = '\0';
 
-		position_from_fen(rootPosition, buf);
-		mv = san2move(rootPosition, bm, 0);
+		position_from_fen(&context->pos, buf);
+		mv = san2move(&context->pos, bm, 0);
 		if (!mv) {
 			cout << "Failed to parse best move of " << id << ", skipping: " << bm << endl;
 			continue;
@@ -130,6 +146,14 @@ run_tests(void)
 {
 	char fen[256];
 	vector<string> successes, failures;
+	uint64 startTime, nodes = 0;
+	uint64 cutoffs = 0, firstMoveCutoffs = 0, pvsResearches = 0, nullCutoffs = 0;
+	uint64 lmrReductions = 0, lmrResearches = 0;
+	uint64 pawnProbes = 0, pawnHits = 0, evals = 0, lazyEvals = 0, cachedEvals = 0;
+	int failHighs = 0, failLows = 0;
+	hash_stats_t hashStats;
+	phash_stats_t pawnHashStats;
+	eval_stats_t evalStats;
 
 	// tell report_search_info() to be quit
 	suppressSearchStatus = true;
@@ -139,16 +163,42 @@ run_tests(void)
 		exit(1);
 	}
 
-	cout << "Running all available tests, " << moveTime << "ms per move." << endl;
+	if (depthLimit)
+		cout << "Running all available tests to depth " << depthLimit << ", " << context->threads << " threads." << endl;
+	else
+		cout << "Running all available tests, " << moveTime << "ms per move, " << context->threads << " threads." << endl;
+
+	// with a depth limit, the time to reach it is the measure
+	context->info.inf = depthLimit != 0;
+	context->info.depthLimit = depthLimit;
+	startTime = get_time();
+
 	for (uint32 i = 0; i < positions.size(); i++) {
 		strcpy(fen, positions[i].c_str());
 		move_t bmv = expectedMoves[i];
 
 		cout << endl << "Testing " << epdIds[i] << ": " << fen << endl;
-		position_from_fen(rootPosition, fen);
-		searchInfo->endTime = clock() + moveTime;
-
-		move_t found = search(rootPosition);
+		position_from_fen(&context->pos, fen);
+		history_new_game(context);
+		clear_history_scores(context);
+		context->info.endTime = get_time() + moveTime;
+
+		move_t found = search(context);
+		nodes += search_nodes(context);
+		cutoffs += context->info.cutoffs;
+		firstMoveCutoffs += context->info.firstMoveCutoffs;
+		failHighs += context->info.failHighs;
+		failLows += context->info.failLows;
+		pvsResearches += context->info.pvsResearches;
+		nullCutoffs += context->info.nullCutoffs;
+		lmrReductions += context->info.lmrReductions;
+		lmrResearches += context->info.lmrResearches;
+		search_stats(context, &hashStats, &pawnHashStats, &evalStats);
+		pawnProbes += pawnHashStats.probes;
+		pawnHits += pawnHashStats.hits;
+		evals += evalStats.calls;
+		lazyEvals += evalStats.lazyExits;
+		cachedEvals += evalStats.cacheHits;
 		if (found != bmv) {
 			cout << "\tFailed; found move: " << move2san(found);
 			cout << "; expected: " << move2san(bmv) << endl;
@@ -163,14 +213,28 @@ run_tests(void)
 	cout << endl << "End results:" << endl;
 	cout << "\t" << successes.size() << " correct searches." << endl;
 	cout << "\t" << failures.size()  << " incorrect searches." << endl;
+	printf("\t%llu nodes searched.\n", nodes);
+	printf("\t%.1f%% of cutoffs on the first move.\n",
+			cutoffs ? 100.0 * firstMoveCutoffs / cutoffs : 0.0);
+	printf("\t%d aspiration fail highs, %d fail lows, %llu pvs re-searches.\n",
+			failHighs, failLows, pvsResearches);
+	printf("\t%llu null move cutoffs.\n", nullCutoffs);
+	printf("\t%llu late move reductions, %llu re-searched.\n", lmrReductions, lmrResearches);
+	printf("\t%.1f%% pawn hash hits.\n", pawnProbes ? 100.0 * pawnHits / pawnProbes : 0.0);
+	printf("\t%llu evaluations, %.1f%% lazy, %.1f%% from the eval cache.\n", evals,
+			evals ? 100.0 * lazyEvals / evals : 0.0, evals ? 100.0 * cachedEvals / evals : 0.0);
+	printf("\t%.2f secs in total.\n", (get_time() - startTime) / 1000.0);
 }
 
 void
 usage(void)
 {
-	printf("usage: epdtest [-help] [-time <sec>] [-file <file.epd>]\n");
+	printf("usage: epdtest [-help] [-time <sec>|-depth <n>] [-threads <n>] [-net <file>] [-file <file.epd>]\n");
 	printf("       -help: prints this.\n");
 	printf("       -time: specifies the time allowed for the search. (default: 10s)\n");
+	printf("       -depth: searches each position to <n> plies instead, for timing.\n");
+	printf("       -threads: number of search threads. (default: 1)\n");
+	printf("       -net: evaluates with the network in <file>.\n");
 	printf("       -file: specifies the file to read the EPD positions from.\n");
 	exit(1);
 }
@@ -1,13 +1,243 @@
 #include "benthos.h"
+#include <cstring>
 #include "eval.h"
 
+int psqTables[2][16][64];
+
+///////////////////////////////
+// the eval cache: a direct mapped table of full evaluations by hash
+// key, so that a position reached again by transposition isn't
+// evaluated over again. like the transposition table, an entry is a
+// single 64 bit word, loaded and stored in one go, so threads can
+// share the cache without locking. the upper 48 bits of the key are
+// the check, and the lower 16 the score for the side to move.
+///////////////////////////////
+static uint64 *evalCache = NULL;
+static uint64  evalCacheMask;
+
+#define EvalCacheCheck(key)   ((key) & ~ULL(0xffff))
+#define EvalCacheScore(word)  ((int)(int16)((word) & 0xffff))
+#define LoadEvalEntry(e)      (__atomic_load_n(e, __ATOMIC_RELAXED))
+#define StoreEvalEntry(e, w)  (__atomic_store_n(e, (w), __ATOMIC_RELAXED))
+
+///////////////////////////////
+// the piece-square tables, from white's point of view, laid out as
+// the board is seen from white's side: a8 first, h1 last. the knight,
+// bishop, rook and queen tables serve both phases.
+///////////////////////////////
+static const int pawnMidgame[64] = {
+	  0,   0,   0,   0,   0,   0,   0,   0,
+	 20,  20,  20,  25,  25,  20,  20,  20,
+	 10,  10,  15,  20,  20,  15,  10,  10,
+	  5,   5,  10,  20,  20,  10,   5,   5,
+	  0,   0,   5,  15,  15,   5,   0,   0,
+	  5,  -5,   0,   5,   5,   0,  -5,   5,
+	  5,  10,  10, -15, -15,  10,  10,   5,
+	  0,   0,   0,   0,   0,   0,   0,   0,
+};
+static const int pawnEndgame[64] = {
+	  0,   0,   0,   0,   0,   0,   0,   0,
+	 30,  30,  30,  30,  30,  30,  30,  30,
+	 20,  20,  20,  20,  20,  20,  20,  20,
+	 10,  10,  10,  10,  10,  10,  10,  10,
+	  5,   5,   5,   5,   5,   5,   5,   5,
+	  0,   0,   0,   0,   0,   0,   0,   0,
+	  0,   0,   0,   0,   0,   0,   0,   0,
+	  0,   0,   0,   0,   0,   0,   0,   0,
+};
+static const int knightTable[64] = {
+	-50, -40, -30, -30, -30, -30, -40, -50,
+	-40, -20,   0,   0,   0,   0, -20, -40,
+	-30,   0,  10,  15,  15,  10,   0, -30,
+	-30,   5,  15,  20,  20,  15,   5, -30,
+	-30,   0,  15,  20,  20,  15,   0, -30,
+	-30,   5,  10,  15,  15,  10,   5, -30,
+	-40, -20,   0,   5,   5,   0, -20, -40,
+	-50, -40, -30, -30, -30, -30, -40, -50,
+};
+static const int bishopTable[64] = {
+	-20, -10, -10, -10, -10, -10, -10, -20,
+	-10,   0,   0,   0,   0,   0,   0, -10,
+	-10,   0,   5,  10,  10,   5,   0, -10,
+	-10,   5,   5,  10,  10,   5,   5, -10,
+	-10,   0,  10,  10,  10,  10,   0, -10,
+	-10,  10,  10,  10,  10,  10,  10, -10,
+	-10,   5,   0,   0,   0,   0,   5, -10,
+	-20, -10, -10, -10, -10, -10, -10, -20,
+};
+static const int rookTable[64] = {
+	  0,   0,   0,   0,   0,   0,   0,   0,
+	  5,  10,  10,  10,  10,  10,  10,   5,
+	 -5,   0,   0,   0,   0,   0,   0,  -5,
+	 -5,   0,   0,   0,   0,   0,   0,  -5,
+	 -5,   0,   0,   0,   0,   0,   0,  -5,
+	 -5,   0,   0,   0,   0,   0,   0,  -5,
+	 -5,   0,   0,   0,   0,   0,   0,  -5,
+	  0,   0,   0,   5,   5,   0,   0,   0,
+};
+static const int queenTable[64] = {
+	-20, -10, -10,  -5,  -5, -10, -10, -20,
+	-10,   0,   0,   0,   0,   0,   0, -10,
+	-10,   0,   5,   5,   5,   5,   0, -10,
+	 -5,   0,   5,   5,   5,   5,   0,  -5,
+	  0,   0,   5,   5,   5,   5,   0,  -5,
+	-10,   5,   5,   5,   5,   5,   0, -10,
+	-10,   0,   5,   0,   0,   0,   0, -10,
+	-20, -10, -10,  -5,  -5, -10, -10, -20,
+};
+static const int kingMidgame[64] = {
+	-30, -40, -40, -50, -50, -40, -40, -30,
+	-30, -40, -40, -50, -50, -40, -40, -30,
+	-30, -40, -40, -50, -50, -40, -40, -30,
+	-30, -40, -40, -50, -50, -40, -40, -30,
+	-20, -30, -30, -40, -40, -30, -30, -20,
+	-10, -20, -20, -20, -20, -20, -20, -10,
+	 20,  20,   0,   0,   0,   0,  20,  20,
+	 20,  30,  10,   0,   0,  10,  30,  20,
+};
+static const int kingEndgame[64] = {
+	-50, -40, -30, -20, -20, -30, -40, -50,
+	-30, -20, -10,   0,   0, -10, -20, -30,
+	-30, -10,  20,  30,  30,  20, -10, -30,
+	-30, -10,  30,  40,  40,  30, -10, -30,
+	-30, -10,  30,  40,  40,  30, -10, -30,
+	-30, -10,  20,  30,  30,  20, -10, -30,
+	-30, -30,   0,   0,   0,   0, -30, -30,
+	-50, -30, -30, -30, -30, -30, -30, -50,
+};
+
+// by phase and piece type
+static const int *psqSources[2][8] = {
+	{ NULL, pawnMidgame, knightTable, kingMidgame, NULL, bishopTable, rookTable, queenTable },
+	{ NULL, pawnEndgame, knightTable, kingEndgame, NULL, bishopTable, rookTable, queenTable },
+};
+
+///////////////////////////////
+// fills in psqTables from the tables above. a white piece on sq reads
+// the table at sq^56, as the tables start from a8, and a black piece
+// reads it at sq, which mirrors the board, negated.
+///////////////////////////////
+void
+init_eval(void)
+{
+	memset(psqTables, 0, sizeof(psqTables));
+
+	for (int phase = MIDGAME; phase <= ENDGAME; phase++)
+		for (int type = PAWN; type <= QUEEN; type++) {
+			if (psqSources[phase][type] == NULL)
+				continue;
+			for (int sq = 0; sq < 64; sq++) {
+				psqTables[phase][MakePiece(type, WHITE)][sq] =  psqSources[phase][type][sq ^ 56];
+				psqTables[phase][MakePiece(type, BLACK)][sq] = -psqSources[phase][type][sq];
+			}
+		}
+}
+
+///////////////////////////////
+// prepares the eval cache, using the largest power of two number of
+// entries that fits in size bytes.
+///////////////////////////////
+void
+init_eval_cache(int size)
+{
+	uint64 max = 1;
+
+	while (max * 2 * sizeof(uint64) <= (uint64)size)
+		max *= 2;
+
+	free(evalCache);
+	if ((evalCache = (uint64 *)malloc(max * sizeof(uint64))) == NULL) {
+		cout << "Failed to allocate eval cache memory: " << (max * sizeof(uint64)) << " bytes" << endl;
+		evalCacheMask = 0;
+		return;
+	}
+	evalCacheMask = max - 1;
+	clear_eval_cache();
+}
+
+///////////////////////////////
+// empties the cache. needed whenever the evaluation itself changes,
+// as when a network is loaded.
+///////////////////////////////
+void
+clear_eval_cache(void)
+{
+	if (evalCache != NULL)
+		memset(evalCache, 0, (evalCacheMask + 1) * sizeof(uint64));
+}
+
+static inline bool
+probe_eval_cache(hashkey_t key, int *score)
+{
+	uint64 word;
+
+	if (evalCache == NULL)
+		return false;
+	word = LoadEvalEntry(&evalCache[key & evalCacheMask]);
+	if (word == 0 || EvalCacheCheck(word) != EvalCacheCheck(key))
+		return false;
+	*score = EvalCacheScore(word);
+	return true;
+}
+
+static inline void
+store_eval_cache(hashkey_t key, int score)
+{
+	if (evalCache != NULL)
+		StoreEvalEntry(&evalCache[key & evalCacheMask], EvalCacheCheck(key) | (uint16)score);
+}
+
+///////////////////////////////
+// blends the midgame and endgame piece-square sums by the material
+// left on the board besides kings and pawns.
+///////////////////////////////
+static inline int
+tapered_psq(const position_t *pos, int ply)
+{
+	int material = Material(ply, WHITE) - Material(ply, BLACK)
+		- 2 * PieceValue(WKING) - (PawnCount(ply, WHITE) + PawnCount(ply, BLACK)) * PieceValue(WPAWN);
+	int phase;
+
+	if (material >= MIDGAME_MATERIAL)
+		phase = PHASE_MAX;
+	else if (material <= ENDGAME_MATERIAL)
+		phase = 0;
+	else
+		phase = (material - ENDGAME_MATERIAL) * PHASE_MAX / (MIDGAME_MATERIAL - ENDGAME_MATERIAL);
+
+	return (PsqScore(ply, MIDGAME) * phase + PsqScore(ply, ENDGAME) * (PHASE_MAX - phase)) / PHASE_MAX;
+}
+
 ///////////////////////////////
 // should return scores from perspective of side to move
+//
+// the cheap terms, kept up by make_move or counted off the bitboards,
+// come first. if they leave the score more than LAZY_EVAL_MARGIN
+// outside the alpha-beta window, the rest can't bring it back in, and
+// the score is returned as it is. pass -INFINITY and INFINITY for the
+// full evaluation. the eval cache is only looked in once the lazy exit
+// has been passed up, and only full evaluations go into it, as a lazy
+// one only holds for its window.
 ///////////////////////////////
 int
-eval(const position_t *pos, int ply)
+eval(const position_t *pos, int ply, int alpha, int beta, search_info_t *info)
 {
 	int score = Material(ply, WHITE) + Material(ply, BLACK);
+	int lazy;
+	phash_entry_t pawns;
+
+	info->evalStats.calls++;
+	if (nnueEnabled) {
+		if (probe_eval_cache(HashKey(ply), &score)) {
+			info->evalStats.cacheHits++;
+			return score;
+		}
+		score = nnue_eval(pos, ply);
+		store_eval_cache(HashKey(ply), score);
+		return score;
+	}
+
+	score += tapered_psq(pos, ply);
 
 	if (Bishops(WHITE) != 0 && (Bishops(WHITE) & (Bishops(WHITE) - 1)) != 0)
 		score += BISHOP_PAIR_BONUS;
@@ -38,5 +268,25 @@ eval(const position_t *pos, int ply)
 		score -= bRooks   * ROOK_PAWN_BONUS;
 	}
 
-	return Stm(ply) == WHITE ? score : -score;
+	lazy = Stm(ply) == WHITE ? score : -score;
+	if (lazy - LAZY_EVAL_MARGIN >= beta || lazy + LAZY_EVAL_MARGIN <= alpha) {
+		info->evalStats.lazyExits++;
+		return lazy;
+	}
+
+	// a lazy exit is cheaper still than a trip to the cache
+	if (probe_eval_cache(HashKey(ply), &lazy)) {
+		info->evalStats.cacheHits++;
+		return lazy;
+	}
+
+	probe_pawns(pos, ply, &pawns, &info->pawnHashStats);
+	score += pawns.score;
+
+	score += popcnt(Knights(WHITE) & WHITE_OUTPOSTS & ~pawns.attackSpans[BLACK]) * KNIGHT_OUTPOST_BONUS;
+	score -= popcnt(Knights(BLACK) & BLACK_OUTPOSTS & ~pawns.attackSpans[WHITE]) * KNIGHT_OUTPOST_BONUS;
+
+	score = Stm(ply) == WHITE ? score : -score;
+	store_eval_cache(HashKey(ply), score);
+	return score;
 }
@@ -11,4 +11,30 @@
 // bonus/penalty for rooks, per pawn < and > 5, respectively: 1/8 pawn
 #define ROOK_PAWN_BONUS    12
 
+// the piece-square tables are blended between the midgame and the
+// endgame by the material left besides kings and pawns, both sides
+// counted. the full set is 6550.
+#define MIDGAME_MATERIAL  6000
+#define ENDGAME_MATERIAL  1500
+#define PHASE_MAX          256
+
+// the pawn structure and the terms that go with it are skipped when
+// the rest of the evaluation is this far outside the window. it has
+// to cover the most they can add up to in any usual position.
+#define LAZY_EVAL_MARGIN 300
+
+// penalties for weak pawns
+#define DOUBLED_PAWN_PENALTY   10
+#define ISOLATED_PAWN_PENALTY  15
+#define BACKWARD_PAWN_PENALTY   8
+
+// bonus for a knight on an outpost: on the 4th to 6th ranks of the
+// enemy's side, where no enemy pawn can ever attack it
+#define KNIGHT_OUTPOST_BONUS   15
+#define WHITE_OUTPOSTS  ULL(0x0000ffffff000000)
+#define BLACK_OUTPOSTS  ULL(0x000000ffffff0000)
+
+// bonus for passed pawns, by rank from the pawn's own side
+static const int passedPawnBonus[8] = { 0, 5, 10, 20, 35, 60, 100, 0 };
+
 #endif // !defined(BENTHOS_EVAL_H)
@@ -0,0 +1,347 @@
+#include "benthos.h"
+#include <cstring>
+#include <sys/time.h>
+#include <vector>
+#include "eval.h"
+#include "nnue.h"
+#include "search.h"
+
+///////////////////////////////
+// compares the network with the classical evaluation, run as a
+// separate program like perft. over the positions of an epd file:
+//
+//   the cost of a static evaluation, of each
+//   the cost of making and unmaking every legal move, with and
+//   without the accumulator kept up to date
+//   a fixed depth search, with each, for the node rate and how often
+//   the two agree on the best move
+//
+// it also checks that the incrementally updated accumulators match
+// ones summed up from scratch, two plies deep from every position.
+// without a network, only the classical evaluation is timed. no eval
+// cache is set up, so every evaluation is computed in full.
+//
+// the lazy exit of the classical evaluation is checked the same way,
+// two plies deep: each node is evaluated in full, then with a null
+// window either side of that score. a lazy exit that lands on the
+// wrong side of one of them is a bound the full evaluation breaks,
+// because the skipped terms added up to more than LAZY_EVAL_MARGIN.
+///////////////////////////////
+
+void   load_positions(void);
+void   bench_eval(void);
+void   bench_make(void);
+void   bench_search(void);
+int    verify_tree(position_t *, int, int);
+int    check_lazy_tree(position_t *, int, int, uint64 *);
+double wall_time(void);
+void   usage(void);
+
+search_context_t *context;
+position_t       *pos;
+
+char            *epdFilename = NULL;
+char            *netFilename = NULL;
+int              depthLimit = 6;
+int              passes = 10000;
+vector<string>   positions;
+vector<move_t>   classicalMoves;
+
+// read through a volatile, so the compiler keeps the work
+volatile int     sink;
+
+int
+main(int argc, char *argv[])
+{
+	int mismatches = 0, wrongBounds = 0;
+	uint64 lazyNodes = 0;
+
+	init_mersenne();
+	init_bitboards();
+	init_zobrist();
+	init_eval();
+	init_hash(33554432);
+	init_pawn_hash(2097152);
+	context = new_search_context();
+	pos = (position_t *)malloc(sizeof(position_t));
+	suppressSearchStatus = true;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-help"))
+			usage();
+		else if (!strcmp(argv[i], "-file")) {
+			if (argc <= i + 1)
+				usage();
+			epdFilename = argv[++i];
+		} else if (!strcmp(argv[i], "-net")) {
+			if (argc <= i + 1)
+				usage();
+			netFilename = argv[++i];
+		} else if (!strcmp(argv[i], "-depth")) {
+			if (argc <= i + 1)
+				usage();
+			depthLimit = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-passes")) {
+			if (argc <= i + 1)
+				usage();
+			passes = atoi(argv[++i]);
+		} else
+			usage();
+	}
+
+	if (epdFilename == NULL)
+		usage();
+	if (netFilename != NULL && !load_network(netFilename))
+		exit(1);
+
+	load_positions();
+	printf("%d positions, network: %s, kernel: %s\n\n", (int)positions.size(),
+			netFilename ? netFilename : "none", NNUE_KERNEL);
+
+	bench_eval();
+	bench_make();
+	bench_search();
+
+	nnueEnabled = false;
+	for (uint32 i = 0; i < positions.size(); i++) {
+		position_from_fen(pos, (char *)positions[i].c_str());
+		wrongBounds += check_lazy_tree(pos, 0, 2, &lazyNodes);
+	}
+	printf("\nlazy eval, margin %d:\n", LAZY_EVAL_MARGIN);
+	printf("  %d wrong bounds in %llu nodes\n", wrongBounds, lazyNodes);
+
+	if (netFilename != NULL) {
+		for (uint32 i = 0; i < positions.size(); i++) {
+			position_from_fen(pos, (char *)positions[i].c_str());
+			mismatches += verify_tree(pos, 0, 2);
+		}
+		printf("\naccumulator mismatches: %d\n", mismatches);
+	}
+
+	return mismatches != 0;
+}
+
+///////////////////////////////
+// reads the positions, skipping any that won't set up. only the fen
+// part of an epd line is read by position_from_fen.
+///////////////////////////////
+void
+load_positions(void)
+{
+	FILE *fp = fopen(epdFilename, "r");
+	char buf[1024];
+
+	if (fp == NULL) {
+		printf("Could not open input file: %s\n", epdFilename);
+		exit(1);
+	}
+
+	while (fgets(buf, sizeof(buf), fp) != NULL) {
+		buf[strcspn(buf, "\r\n")] = '\0';
+		if (buf[0] == '\0' || buf[0] == '#')
+			continue;
+		if (position_from_fen(pos, buf))
+			positions.push_back(buf);
+	}
+	fclose(fp);
+
+	if (positions.empty()) {
+		printf("No positions in %s\n", epdFilename);
+		exit(1);
+	}
+}
+
+///////////////////////////////
+// times eval() on each position, passes times over, with and without
+// the network. with both, also reports how far apart their scores are.
+///////////////////////////////
+void
+bench_eval(void)
+{
+	double classical = 0, network = 0, start, diff = 0;
+	int score;
+
+	for (uint32 i = 0; i < positions.size(); i++) {
+		nnueEnabled = false;
+		position_from_fen(pos, (char *)positions[i].c_str());
+		start = wall_time();
+		for (int n = 0; n < passes; n++)
+			sink = eval(pos, 0, -INFINITY, INFINITY, &context->info);
+		classical += wall_time() - start;
+		score = sink;
+
+		if (netFilename == NULL)
+			continue;
+
+		nnueEnabled = true;
+		refresh_accumulator(pos, 0);
+		start = wall_time();
+		for (int n = 0; n < passes; n++)
+			sink = eval(pos, 0, -INFINITY, INFINITY, &context->info);
+		network += wall_time() - start;
+		diff += abs(sink - score);
+	}
+
+	double calls = (double)passes * positions.size();
+	printf("static eval, ns per call:\n");
+	printf("  classical %10.1f\n", classical * 1e9 / calls);
+	if (netFilename != NULL) {
+		printf("  network   %10.1f\n", network * 1e9 / calls);
+		printf("  mean difference %.1f cp\n", diff / positions.size());
+	}
+}
+
+///////////////////////////////
+// times making and unmaking every legal move from each position,
+// which is what keeping the accumulators up to date costs.
+///////////////////////////////
+void
+bench_make(void)
+{
+	scored_move_t moves[256], *end, *mv;
+	double time[2] = { 0, 0 }, start;
+	uint64 count = 0;
+	int runs = netFilename ? 2 : 1;
+	int movePasses = Max(passes / 10, 1);
+
+	for (int run = 0; run < runs; run++) {
+		nnueEnabled = run == 1;
+		for (uint32 i = 0; i < positions.size(); i++) {
+			position_from_fen(pos, (char *)positions[i].c_str());
+			end = generate_moves(pos, moves, 0);
+			if (run == 0)
+				count += (end - moves) * movePasses;
+			start = wall_time();
+			for (int n = 0; n < movePasses; n++)
+				for (mv = moves; mv < end; mv++) {
+					make_move(pos, mv->move, 0);
+					unmake_move(pos, mv->move, 0);
+				}
+			time[run] += wall_time() - start;
+		}
+	}
+
+	printf("\nmake/unmake, ns per move:\n");
+	printf("  classical %10.1f\n", time[0] * 1e9 / count);
+	if (netFilename != NULL)
+		printf("  network   %10.1f\n", time[1] * 1e9 / count);
+}
+
+///////////////////////////////
+// searches every position to depthLimit with the classical evaluation,
+// then with the network.
+///////////////////////////////
+void
+bench_search(void)
+{
+	int runs = netFilename ? 2 : 1;
+	int agree = 0;
+	uint64 nodes, start;
+	double secs;
+	move_t move;
+
+	printf("\ndepth %d search:\n", depthLimit);
+	context->info.depthLimit = depthLimit;
+	for (int run = 0; run < runs; run++) {
+		nnueEnabled = run == 1;
+		clear_hash();
+		nodes = 0;
+		start = get_time();
+		for (uint32 i = 0; i < positions.size(); i++) {
+			position_from_fen(&context->pos, (char *)positions[i].c_str());
+			history_new_game(context);
+			clear_history_scores(context);
+			context->info.endTime = get_time() + 3600000;
+			move = search(context);
+			nodes += search_nodes(context);
+			if (run == 0)
+				classicalMoves.push_back(move);
+			else if (move == classicalMoves[i])
+				agree++;
+		}
+		secs = (get_time() - start) / 1000.0;
+		printf("  %-9s %12llu nodes %8.2f secs %10.0f nps\n", run ? "network" : "classical",
+				nodes, secs, secs > 0 ? nodes / secs : 0.0);
+	}
+	if (netFilename != NULL)
+		printf("  same best move in %d of %d positions\n", agree, (int)positions.size());
+}
+
+///////////////////////////////
+// checks the accumulators of every node below ply, to depth plies.
+// returns the number that didn't match.
+///////////////////////////////
+int
+verify_tree(position_t *pos, int ply, int depth)
+{
+	scored_move_t moves[256], *end, *mv;
+	int mismatches = !verify_accumulator(pos, ply);
+
+	if (depth == 0)
+		return mismatches;
+
+	end = generate_moves(pos, moves, ply);
+	for (mv = moves; mv < end; mv++) {
+		make_move(pos, mv->move, ply);
+		mismatches += verify_tree(pos, ply + 1, depth - 1);
+		unmake_move(pos, mv->move, ply);
+	}
+
+	return mismatches;
+}
+
+///////////////////////////////
+// checks the lazy exits of every node below ply, to depth plies, and
+// counts the nodes into nodes. the full score fails low against the
+// window just above it and high against the one just below, so a
+// score that fails the other way is a lazy exit on the wrong side.
+// returns the number of those.
+///////////////////////////////
+int
+check_lazy_tree(position_t *pos, int ply, int depth, uint64 *nodes)
+{
+	scored_move_t moves[256], *end, *mv;
+	int full = eval(pos, ply, -INFINITY, INFINITY, &context->info);
+	int wrong = 0;
+
+	(*nodes)++;
+	if (eval(pos, ply, full, full + 1, &context->info) > full)
+		wrong++;
+	if (eval(pos, ply, full - 1, full, &context->info) < full)
+		wrong++;
+
+	if (depth == 0)
+		return wrong;
+
+	end = generate_moves(pos, moves, ply);
+	for (mv = moves; mv < end; mv++) {
+		make_move(pos, mv->move, ply);
+		wrong += check_lazy_tree(pos, ply + 1, depth - 1, nodes);
+		unmake_move(pos, mv->move, ply);
+	}
+
+	return wrong;
+}
+
+///////////////////////////////
+// returns the wall clock time in seconds.
+///////////////////////////////
+double
+wall_time(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void
+usage(void)
+{
+	printf("usage: evalbench [-help] [-net <file>] [-depth <n>] [-passes <n>] -file <file.epd>\n");
+	printf("       -help  : prints this.\n");
+	printf("       -net   : the network to compare with the classical evaluation.\n");
+	printf("       -depth : depth of the searches. (default: 6)\n");
+	printf("       -passes: static evaluations per position. (default: 10000)\n");
+	printf("       -file  : specifies the file to read the positions from.\n");
+	exit(1);
+}
@@ -1,66 +1,225 @@
 #include "benthos.h"
+#include <cstring>
+#include <climits>
 
-hash_entry_t *hashTable;
-int hashMaxEntries;
+///////////////////////////////
+// the transposition table. it's made of 64 byte aligned buckets of
+// compact entries, and a key maps to a single bucket, so a probe only
+// ever looks at one cache line. within the bucket, a store replaces
+// the entry for the same position if there is one, and otherwise the
+// shallowest entry, counting older searches' entries as shallower.
+//
+// the age is a generation counter bumped at the start of each search.
+// without it, deep entries from earlier moves would never give way to
+// the current search's.
+//
+// the table can be shared by search threads without any locking. an
+// entry fits in a single 64 bit word, which is loaded into a local copy
+// and stored back in one go, so a reader sees either the old entry or
+// the new one, never a mix. two threads storing into a bucket at once
+// can lose one of the stores, which costs nothing but the entry.
+///////////////////////////////
+
+hash_bucket_t *hashTable;
+uint64 hashBucketCount;
+uint8 hashAge;
+
+static void *hashMemory = NULL;
+
+// scores are stored in 16 bits. the bounds at the edges of the window
+// can be as large as INFINITY, but are still valid bounds when clamped.
+#define HASH_SCORE_MAX 32000
+
+#define LoadEntry(e)     (__atomic_load_n(&(e)->word, __ATOMIC_RELAXED))
+#define StoreEntry(e, w) (__atomic_store_n(&(e)->word, (w), __ATOMIC_RELAXED))
+
+static hash_entry_t *lookup_hash(hashkey_t, hash_entry_t *);
 
 ///////////////////////////////
-// prepares the hash table.
+// prepares the hash table, using the largest power of two number of
+// buckets that fits in size bytes.
 ///////////////////////////////
 void
 init_hash(int size)
 {
-	int max;
+	uint64 max;
 
 	max = 1;
 	while (true) {
-		if ((int)(max * 2 * sizeof(hash_entry_t)) > size)
+		if (max * 2 * sizeof(hash_bucket_t) > (uint64)size)
 			break;
 		max *= 2;
 	}
-	if ((hashTable = (hash_entry_t *)malloc(max * sizeof(hash_entry_t))) == NULL) {
-		cout << "Failed to allocate hash memory: " << (max * sizeof(hash_entry_t)) << " bytes" << endl;
+
+	// malloc only promises 8 or 16 byte alignment, so the table is
+	// aligned to the cache line by hand.
+	free(hashMemory);
+	if ((hashMemory = malloc(max * sizeof(hash_bucket_t) + HASH_BUCKET_ALIGN)) == NULL) {
+		cout << "Failed to allocate hash memory: " << (max * sizeof(hash_bucket_t)) << " bytes" << endl;
+		hashTable = NULL;
+		hashBucketCount = 0;
 		return;
 	}
-	hashMaxEntries = max;
+	hashTable = (hash_bucket_t *)(((size_t)hashMemory + HASH_BUCKET_ALIGN - 1) & ~(size_t)(HASH_BUCKET_ALIGN - 1));
+	hashBucketCount = max;
 	clear_hash();
 }
 
 void
 clear_hash()
 {
-	memset(hashTable, 0, hashMaxEntries * sizeof(hash_entry_t));
+	memset(hashTable, 0, hashBucketCount * sizeof(hash_bucket_t));
+	hashAge = 0;
 }
 
+///////////////////////////////
+// starts a new generation of entries.
+///////////////////////////////
+void
+new_hash_search(void)
+{
+	hashAge = (hashAge + 1) & HASH_AGE_MASK;
+}
+
+///////////////////////////////
+// returns the permill of entries stored by the current search,
+// sampled from the first thousand buckets, for uci's hashfull.
+///////////////////////////////
 int
-probe_hash(hashkey_t key, int depth, int alpha, int beta, move_t *move)
+hash_full(void)
+{
+	uint64 buckets = Min(hashBucketCount, 1000);
+	int used = 0;
+
+	hash_entry_t entry;
+
+	for (uint64 i = 0; i < buckets; i++)
+		for (int j = 0; j < HASH_BUCKET_SIZE; j++) {
+			entry.word = LoadEntry(&hashTable[i].entries[j]);
+			if (entry.flags && HashAge(&entry) == hashAge)
+				used++;
+		}
+
+	return used * 1000 / (buckets * HASH_BUCKET_SIZE);
+}
+
+///////////////////////////////
+// finds the entry for key in its bucket. returns the slot it's in,
+// with a copy of the entry, or NULL if there's none.
+///////////////////////////////
+static hash_entry_t *
+lookup_hash(hashkey_t key, hash_entry_t *entry)
 {
-	hash_entry_t *entry = &hashTable[key % hashMaxEntries];
+	hash_bucket_t *bucket = &hashTable[key & (hashBucketCount - 1)];
+	uint16 check = HashCheck(key);
 
-	if (entry->key != key)
+	for (int i = 0; i < HASH_BUCKET_SIZE; i++) {
+		entry->word = LoadEntry(&bucket->entries[i]);
+		if (entry->check == check && entry->flags)
+			return &bucket->entries[i];
+	}
+
+	return NULL;
+}
+
+///////////////////////////////
+// copies out the entry for key, returning false if there's none.
+///////////////////////////////
+bool
+read_hash(hashkey_t key, hash_entry_t *entry)
+{
+	return lookup_hash(key, entry) != NULL;
+}
+
+int
+probe_hash(hashkey_t key, int depth, int alpha, int beta, move_t *move, hash_stats_t *stats)
+{
+	hash_entry_t entry;
+	hash_entry_t *slot;
+
+	stats->probes++;
+	if ((slot = lookup_hash(key, &entry)) == NULL)
 		return HASH_VAL_UNKNOWN;
 
-	if (depth <= entry->depth) {
-		if (entry->type == EXACT)
-			return entry->score;
-		if (entry->type == ALPHA && entry->score <= alpha)
+	// an entry that's still in use is brought up to the current age,
+	// so that it isn't replaced as stale. if another thread has stored
+	// into the slot since, its entry is lost, but nothing is mixed.
+	stats->hits++;
+	if (HashAge(&entry) != hashAge) {
+		entry.flags = HashFlags(HashBound(&entry), hashAge);
+		StoreEntry(slot, entry.word);
+	}
+
+	if (depth <= entry.depth) {
+		if (HashBound(&entry) == EXACT)
+			return entry.score;
+		if (HashBound(&entry) == ALPHA && entry.score <= alpha)
 			return alpha;
-		if (entry->type == BETA  && entry->score >= beta)
+		if (HashBound(&entry) == BETA  && entry.score >= beta)
 			return beta;
 	}
 
-	if (entry->move != 0)
-		*move = entry->move;
+	if (entry.move != 0)
+		*move = entry.move;
 
 	return HASH_VAL_UNKNOWN;
 }
 
 void
-store_hash(hashkey_t key, int depth, int type, int score, move_t move)
+store_hash(hashkey_t key, int depth, int type, int score, move_t move, hash_stats_t *stats)
 {
-	hash_entry_t *entry = &hashTable[key % hashMaxEntries];
-	entry->key = key;
-	entry->depth = depth;
-	entry->type = type;
-	entry->score = score;
-	entry->move = move;
+	hash_bucket_t *bucket = &hashTable[key & (hashBucketCount - 1)];
+	hash_entry_t entry, old, *replace = NULL;
+	uint16 check = HashCheck(key);
+	uint16 packed = HashMove(move);
+	int worth, least = INT_MAX;
+
+	for (int i = 0; i < HASH_BUCKET_SIZE; i++) {
+		entry.word = LoadEntry(&bucket->entries[i]);
+
+		// the same position is always overwritten, keeping the old move
+		// if there's no new one.
+		if (entry.check == check && entry.flags) {
+			if (!packed)
+				packed = entry.move;
+			replace = &bucket->entries[i];
+			old = entry;
+			break;
+		}
+
+		// an empty entry is as shallow as it gets
+		if (!entry.flags) {
+			replace = &bucket->entries[i];
+			old = entry;
+			break;
+		}
+
+		// an entry left by an older search loses 8 plies of depth for
+		// every search since
+		worth = entry.depth - 8 * ((hashAge - HashAge(&entry)) & HASH_AGE_MASK);
+		if (worth < least) {
+			least = worth;
+			replace = &bucket->entries[i];
+			old = entry;
+		}
+	}
+
+	stats->stores++;
+	if (old.flags && old.check != check) {
+		stats->replaced++;
+		if (HashAge(&old) != hashAge)
+			stats->staleReplaced++;
+	}
+
+	if (score > HASH_SCORE_MAX)
+		score = HASH_SCORE_MAX;
+	if (score < -HASH_SCORE_MAX)
+		score = -HASH_SCORE_MAX;
+
+	entry.check = check;
+	entry.move  = packed;
+	entry.score = score;
+	entry.depth = depth;
+	entry.flags = HashFlags(type, hashAge);
+	StoreEntry(replace, entry.word);
 }
@@ -0,0 +1,201 @@
+#include "benthos.h"
+#include <cstring>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sched.h>
+
+///////////////////////////////
+// a stress test for sharing the hash table between threads, run as a
+// separate program like perft. every thread stores and probes a common
+// pool of keys at random, in a deliberately small table, so that the
+// threads keep landing in the same buckets.
+//
+// everything in an entry is a function of its key, so a probe can
+// tell whether what it read was stored whole. a mismatch means an
+// entry was torn between two stores. the pool keys all differ in their
+// upper 16 bits, so a mismatch can't be an ordinary key collision.
+//
+// -unsafe stores the fields of an entry one at a time, as the table
+// used to, to show that the test does catch torn entries.
+///////////////////////////////
+
+void *hammer(void *);
+void  store_unsafe(hashkey_t, int, int, move_t);
+double wall_time(void);
+void  usage(void);
+
+#define POOLSIZE   65536
+
+typedef struct hammer_thread {
+	pthread_t thread;
+	uint64    seed;
+	uint64    stores;
+	uint64    probes;
+	uint64    hits;
+	uint64    corrupt;
+} hammer_thread_t;
+
+int        threads = 4;
+int        tableSize = 65536;
+uint64     operations = 10000000;
+bool       unsafeStores = false;
+hashkey_t  pool[POOLSIZE];
+
+// the contents each key is stored with
+#define ExpectedMove(i)  ((move_t)(((i) * 2654435761u) & 0xfff) | 1)
+#define ExpectedScore(i) ((int)((i) % 64000) - 32000)
+#define ExpectedDepth(i) ((int)((i) % 255) + 1)
+
+///////////////////////////////
+// a small per-thread generator, as genrand_int64 isn't thread-safe.
+///////////////////////////////
+static inline uint64
+xorshift(uint64 *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 7;
+	*s ^= *s << 17;
+	return *s;
+}
+
+int
+main(int argc, char *argv[])
+{
+	hammer_thread_t workers[MAXTHREADS];
+	uint64 stores = 0, probes = 0, hits = 0, corrupt = 0;
+	double start_time, time_used;
+	int i;
+
+	init_mersenne();
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-help"))
+			usage();
+		else if (!strcmp(argv[i], "-unsafe"))
+			unsafeStores = true;
+		else if (!strcmp(argv[i], "-threads")) {
+			if (argc <= i + 1)
+				usage();
+			threads = atoi(argv[++i]);
+			if (threads < 1 || threads > MAXTHREADS)
+				usage();
+		} else if (!strcmp(argv[i], "-size")) {
+			if (argc <= i + 1)
+				usage();
+			tableSize = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-ops")) {
+			if (argc <= i + 1)
+				usage();
+			operations = strtoull(argv[++i], NULL, 10);
+		} else
+			usage();
+	}
+
+	init_hash(tableSize);
+	for (i = 0; i < POOLSIZE; i++)
+		pool[i] = ((hashkey_t)i << 48) | (genrand_int64() & ULL(0xffffffffffff));
+
+	printf("%d threads, %llu operations each, %llu buckets, %s stores\n",
+			threads, operations, hashBucketCount, unsafeStores ? "unsafe" : "whole entry");
+
+	start_time = wall_time();
+	for (i = 0; i < threads; i++) {
+		memset(&workers[i], 0, sizeof(hammer_thread_t));
+		workers[i].seed = genrand_int64() | 1;
+		pthread_create(&workers[i].thread, NULL, hammer, &workers[i]);
+	}
+	for (i = 0; i < threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		stores  += workers[i].stores;
+		probes  += workers[i].probes;
+		hits    += workers[i].hits;
+		corrupt += workers[i].corrupt;
+	}
+	time_used = wall_time() - start_time;
+
+	printf("stores %llu probes %llu hits %llu [%.2f secs]\n",
+			stores, probes, hits, time_used);
+	printf("corrupt entries: %llu\n", corrupt);
+
+	return corrupt != 0;
+}
+
+///////////////////////////////
+// the body of a test thread: half stores, half probes, checking
+// every entry found against what its key should hold.
+///////////////////////////////
+void *
+hammer(void *arg)
+{
+	hammer_thread_t *self = (hammer_thread_t *)arg;
+	hash_entry_t entry;
+	hash_stats_t stats = { 0 };
+	uint64 r, i;
+
+	for (uint64 n = 0; n < operations; n++) {
+		r = xorshift(&self->seed);
+		i = r % POOLSIZE;
+
+		if (r & ULL(0x8000000000000000)) {
+			if (unsafeStores)
+				store_unsafe(pool[i], ExpectedDepth(i), ExpectedScore(i), ExpectedMove(i));
+			else
+				store_hash(pool[i], ExpectedDepth(i), EXACT, ExpectedScore(i), ExpectedMove(i), &stats);
+			self->stores++;
+			continue;
+		}
+
+		self->probes++;
+		if (!read_hash(pool[i], &entry))
+			continue;
+
+		self->hits++;
+		if (entry.move != ExpectedMove(i) || entry.score != ExpectedScore(i)
+				|| entry.depth != ExpectedDepth(i) || HashBound(&entry) != EXACT)
+			self->corrupt++;
+	}
+
+	return NULL;
+}
+
+///////////////////////////////
+// stores an entry a field at a time, into a slot picked from the key.
+// the volatile keeps the compiler from merging the stores, and the
+// yield widens the window, so the race shows up even on one core.
+///////////////////////////////
+void
+store_unsafe(hashkey_t key, int depth, int score, move_t move)
+{
+	hash_bucket_t *bucket = &hashTable[key & (hashBucketCount - 1)];
+	volatile hash_entry_t *entry = &bucket->entries[(key >> 20) % HASH_BUCKET_SIZE];
+
+	entry->check = HashCheck(key);
+	sched_yield();
+	entry->move  = HashMove(move);
+	entry->score = score;
+	entry->depth = depth;
+	entry->flags = HashFlags(EXACT, hashAge);
+}
+
+///////////////////////////////
+// returns the wall clock time in seconds.
+///////////////////////////////
+double
+wall_time(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void
+usage(void)
+{
+	printf("usage: hashtest [-help] [-unsafe] [-threads <n>] [-size <bytes>] [-ops <n>]\n");
+	printf("       -help   : prints this.\n");
+	printf("       -unsafe : stores entries a field at a time, to show torn entries are caught.\n");
+	printf("       -threads: number of threads hammering the table. (default: 4)\n");
+	printf("       -size   : size of the table in bytes. (default: 65536)\n");
+	printf("       -ops    : operations per thread. (default: 10000000)\n");
+	exit(1);
+}
@@ -1,23 +1,20 @@
 #include "benthos.h"
 
 ///////////////////////////////
-// maintains the game history stack.
+// maintains the game history stack of a search context.
 ///////////////////////////////
 
-history_t history[MAXGAMELENGTH];
-int       currentGamePly;
-
 ///////////////////////////////
 // completely clears the history.
 ///////////////////////////////
 void
-reset_history(void)
+reset_history(search_context_t *ctx)
 {
-	currentGamePly = 0;
+	ctx->gamePly = 0;
 	for (int i = 0; i < MAXGAMELENGTH; i++) {
-		history[i].hashKey = 0;
-		history[i].halfmoveClock = 0;
-		history[i].prevMove = 0;
+		ctx->history[i].hashKey = 0;
+		ctx->history[i].halfmoveClock = 0;
+		ctx->history[i].prevMove = 0;
 	}
 }
 
@@ -26,12 +23,14 @@ reset_history(void)
 // information into the first ply.
 ///////////////////////////////
 void
-history_new_game(void)
+history_new_game(search_context_t *ctx)
 {
-	reset_history();
-	history[0].hashKey = HashKey(0);
-	history[0].halfmoveClock = HalfmoveClock(0);
-	history[0].prevMove = 0;
+	position_t *pos = &ctx->pos;
+
+	reset_history(ctx);
+	ctx->history[0].hashKey = HashKey(0);
+	ctx->history[0].halfmoveClock = HalfmoveClock(0);
+	ctx->history[0].prevMove = 0;
 }
 
 ///////////////////////////////
@@ -43,16 +42,20 @@ history_new_game(void)
 // everything is done using the root node in the state stack.
 ///////////////////////////////
 void
-make_history_move(position_t *pos, move_t move)
+make_history_move(search_context_t *ctx, move_t move)
 {
+	position_t *pos = &ctx->pos;
+
 	make_move(pos, move, 0);
 
 	// since we move from state zero -> one, all we have to do is
 	// copy it back to state zero.
-	states[0] = states[1];
+	State(0) = State(1);
+	if (nnueEnabled)
+		Accumulator(0) = Accumulator(1);
 
-	currentGamePly++;
-	history[currentGamePly].hashKey = HashKey(0);
-	history[currentGamePly].halfmoveClock = HalfmoveClock(0);
-	history[currentGamePly].prevMove = move;
+	ctx->gamePly++;
+	ctx->history[ctx->gamePly].hashKey = HashKey(0);
+	ctx->history[ctx->gamePly].halfmoveClock = HalfmoveClock(0);
+	ctx->history[ctx->gamePly].prevMove = move;
 }
@@ -1,27 +1,27 @@
 #include "benthos.h"
 
-// these are used all over the place. might as well situate them here.
-position_t *rootPosition;
-state_t     states[MAXPLY];
-
 void
 init(void)
 {
-	rootPosition = (position_t *)malloc(sizeof(position_t));
 	init_mersenne();
 	init_bitboards();
 	init_zobrist();
+	init_eval();
 	init_hash(33554432); // 32mb, move elsewhere TODO
-	init_search();
+	init_pawn_hash(2097152);
+	init_eval_cache(4194304);
 }
 
 int
 main(void)
 {
+	search_context_t *ctx;
+
 	init();
-	position_from_fen(rootPosition, STARTING_FEN);
-	history_new_game();
-	ui_loop();
+	ctx = new_search_context();
+	position_from_fen(&ctx->pos, STARTING_FEN);
+	history_new_game(ctx);
+	ui_loop(ctx);
 
 	return 0;
 }
@@ -5,13 +5,30 @@
 // in the zobrist hash. just cleans up make_move a bit.
 ///////////////////////////////
 static inline hashkey_t
-change_castling(int ply, hashkey_t oldKey, uint8 andMask)
+change_castling(position_t *pos, int ply, hashkey_t oldKey, uint8 andMask)
 {
 	oldKey ^= ZobristCastling(Castling(ply));
 	Castling(ply) &= andMask;
 	return oldKey ^ ZobristCastling(Castling(ply));
 }
 
+///////////////////////////////
+// adds or removes a piece's piece-square values in the state at ply.
+///////////////////////////////
+static inline void
+add_psq(position_t *pos, int ply, uint8 pc, uint8 sq)
+{
+	PsqScore(ply, MIDGAME) += Psq(MIDGAME, pc, sq);
+	PsqScore(ply, ENDGAME) += Psq(ENDGAME, pc, sq);
+}
+
+static inline void
+remove_psq(position_t *pos, int ply, uint8 pc, uint8 sq)
+{
+	PsqScore(ply, MIDGAME) -= Psq(MIDGAME, pc, sq);
+	PsqScore(ply, ENDGAME) -= Psq(ENDGAME, pc, sq);
+}
+
 ///////////////////////////////
 // performs the provided move on given position, and places all
 // new state information into the index after the specified ply.
@@ -32,7 +49,7 @@ make_move(position_t *pos, move_t move, int ply)
 	hashkey_t  pHashKey = PawnHashKey(ply);
 
 	// update the state information of the new ply
-	states[newply] = states[ply];
+	State(newply) = State(ply);
 	Stm(newply) = opp;
 	EpSquare(newply) = INVALID_SQUARE;
 	HalfmoveClock(newply)++;
@@ -43,11 +60,10 @@ make_move(position_t *pos, move_t move, int ply)
 	else
 		Pieces(BLACK) ^= moveMask;
 	Occupied     ^= moveMask;
-	Occupied90L  ^= Mask90L(from) | Mask90L(to);
-	Occupied45L  ^= Mask45L(from) | Mask45L(to);
-	Occupied45R  ^= Mask45R(from) | Mask45R(to);
 	PieceOn(from) = EMPTY;
 	PieceOn(to)   = pc;
+	remove_psq(pos, newply, pc, from);
+	add_psq(pos, newply, pc, to);
 
 	// predictable hash key updates
 	hashKey ^= ZobristStm;
@@ -71,6 +87,8 @@ make_move(position_t *pos, move_t move, int ply)
 				pHashKey     ^= Zobrist(WPAWN, to);
 				PawnCount(newply, WHITE)--;
 				Material(newply, WHITE) -= PieceValue(WPAWN);
+				remove_psq(pos, newply, WPAWN, to);
+				add_psq(pos, newply, prom, to);
 
 				switch (prom) {
 				case WQUEEN:
@@ -109,14 +127,12 @@ make_move(position_t *pos, move_t move, int ply)
 				Pieces(BLACK) ^= capMask;
 				Pawns(BLACK)  ^= capMask;
 				Occupied      ^= capMask;
-				Occupied90L   ^= Mask90L(capsq);
-				Occupied45L   ^= Mask45L(capsq);
-				Occupied45R   ^= Mask45R(capsq);
 				PieceOn(capsq) = EMPTY;
 				hashKey       ^= Zobrist(BPAWN, capsq);
 				pHashKey      ^= Zobrist(BPAWN, capsq);
 				PawnCount(newply, BLACK)--;
 				Material(newply, BLACK) -= PieceValue(BPAWN);
+				remove_psq(pos, newply, BPAWN, capsq);
 
 				// clear so we don't bother with handling the capture later
 				cap = EMPTY;
@@ -131,6 +147,8 @@ make_move(position_t *pos, move_t move, int ply)
 				pHashKey     ^= Zobrist(BPAWN, to);
 				PawnCount(newply, BLACK)--;
 				Material(newply, BLACK) -= PieceValue(BPAWN);
+				remove_psq(pos, newply, BPAWN, to);
+				add_psq(pos, newply, prom, to);
 
 				switch (prom) {
 				case BQUEEN:
@@ -169,14 +187,12 @@ make_move(position_t *pos, move_t move, int ply)
 				Pieces(WHITE) ^= capMask;
 				Pawns(WHITE)  ^= capMask;
 				Occupied      ^= capMask;
-				Occupied90L   ^= Mask90L(capsq);
-				Occupied45L   ^= Mask45L(capsq);
-				Occupied45R   ^= Mask45R(capsq);
 				PieceOn(capsq) = EMPTY;
 				hashKey       ^= Zobrist(WPAWN, capsq);
 				pHashKey      ^= Zobrist(WPAWN, capsq);
 				PawnCount(newply, WHITE)--;
 				Material(newply, WHITE) -= PieceValue(WPAWN);
+				remove_psq(pos, newply, WPAWN, capsq);
 
 				// clear so we don't bother with handling the capture later
 				cap = EMPTY;
@@ -193,14 +209,14 @@ make_move(position_t *pos, move_t move, int ply)
 		Rooks(stm) ^= moveMask;
 		if (stm == WHITE) {
 			if (from == H1)
-				hashKey = change_castling(newply, hashKey, ~WHITE_CAN_CASTLE_KS);
+				hashKey = change_castling(pos, newply, hashKey, ~WHITE_CAN_CASTLE_KS);
 			else if (from == A1)
-				hashKey = change_castling(newply, hashKey, ~WHITE_CAN_CASTLE_QS);
+				hashKey = change_castling(pos, newply, hashKey, ~WHITE_CAN_CASTLE_QS);
 		} else {
 			if (from == H8)
-				hashKey = change_castling(newply, hashKey, ~BLACK_CAN_CASTLE_KS);
+				hashKey = change_castling(pos, newply, hashKey, ~BLACK_CAN_CASTLE_KS);
 			else if (from == A8)
-				hashKey = change_castling(newply, hashKey, ~BLACK_CAN_CASTLE_QS);
+				hashKey = change_castling(pos, newply, hashKey, ~BLACK_CAN_CASTLE_QS);
 		}
 		break;
 	case QUEEN:
@@ -210,65 +226,61 @@ make_move(position_t *pos, move_t move, int ply)
 		if (stm == WHITE) {
 			Kings(WHITE) ^= moveMask;
 			KingSq(WHITE) = to;
-			hashKey = change_castling(newply, hashKey, ~WHITE_CAN_CASTLE);
+			hashKey = change_castling(pos, newply, hashKey, ~WHITE_CAN_CASTLE);
 
 			if (IsCastle(move)) {
 				if (to == G1) {
-					// constants = Mask{00L,90L,...} H1 | F1
+					// constant = Mask(H1) | Mask(F1)
 					uint64 rookMoveMask = 0xa0;
 					Pieces(WHITE) ^= rookMoveMask;
 					Rooks(WHITE)  ^= rookMoveMask;
 					Occupied      ^= rookMoveMask;
-					Occupied90L   ^= ULL(0x8000800000000000);
-					Occupied45L   ^= ULL(0x800100000);
-					Occupied45R   ^= ULL(0x9);
 					PieceOn(H1)    = EMPTY;
 					PieceOn(F1)    = WROOK;
 					hashKey       ^= Zobrist(WROOK, H1) ^ Zobrist(WROOK, F1);
+					remove_psq(pos, newply, WROOK, H1);
+					add_psq(pos, newply, WROOK, F1);
 				} else if (to == C1) {
-					// constants = Mask{00L,90L,...} A1 | D1
+					// constant = Mask(A1) | Mask(D1)
 					uint64 rookMoveMask = ULL(0x9);
 					Pieces(WHITE) ^= rookMoveMask;
 					Rooks(WHITE)  ^= rookMoveMask;
 					Occupied      ^= rookMoveMask;
-					Occupied90L   ^= ULL(0x80000080);
-					Occupied45L   ^= ULL(0x201);
-					Occupied45R   ^= ULL(0x10000400);
 					PieceOn(A1)    = EMPTY;
 					PieceOn(D1)    = WROOK;
 					hashKey       ^= Zobrist(WROOK, A1) ^ Zobrist(WROOK, D1);
+					remove_psq(pos, newply, WROOK, A1);
+					add_psq(pos, newply, WROOK, D1);
 				}
 			}
 		} else {
 			Kings(BLACK) ^= moveMask;
 			KingSq(BLACK) = to;
-			hashKey = change_castling(newply, hashKey, ~BLACK_CAN_CASTLE);
+			hashKey = change_castling(pos, newply, hashKey, ~BLACK_CAN_CASTLE);
 
 			if (IsCastle(move)) {
 				if (to == G8) {
-					// constants = Mask{00L,90L,...} H8 | F8
+					// constant = Mask(H8) | Mask(F8)
 					uint64 rookMoveMask = ULL(0xa000000000000000);
 					Pieces(BLACK) ^= rookMoveMask;
 					Rooks(BLACK)  ^= rookMoveMask;
 					Occupied      ^= rookMoveMask;
-					Occupied90L   ^= ULL(0x100010000000000);
-					Occupied45L   ^= ULL(0x8400000000000000);
-					Occupied45R   ^= ULL(0x1000800000000);
 					PieceOn(H8)    = EMPTY;
 					PieceOn(F8)    = BROOK;
 					hashKey       ^= Zobrist(BROOK, H8) ^ Zobrist(BROOK, F8);
+					remove_psq(pos, newply, BROOK, H8);
+					add_psq(pos, newply, BROOK, F8);
 				} else if (to == C8) {
-					// constants = Mask{00L,90L,...} A8 | D8
+					// constant = Mask(A8) | Mask(D8)
 					uint64 rookMoveMask = ULL(0x900000000000000);
 					Pieces(BLACK) ^= rookMoveMask;
 					Rooks(BLACK)  ^= rookMoveMask;
 					Occupied      ^= rookMoveMask;
-					Occupied90L   ^= ULL(0x1000001);
-					Occupied45L   ^= ULL(0x2000010000000);
-					Occupied45R   ^= ULL(0x8200000000000000);
 					PieceOn(A8)    = EMPTY;
 					PieceOn(D8)    = BROOK;
 					hashKey       ^= Zobrist(BROOK, A8) ^ Zobrist(BROOK, D8);
+					remove_psq(pos, newply, BROOK, A8);
+					add_psq(pos, newply, BROOK, D8);
 				}
 			}
 		}
@@ -280,6 +292,8 @@ make_move(position_t *pos, move_t move, int ply)
 	if (cap == EMPTY) {
 		HashKey(newply) = hashKey;
 		PawnHashKey(newply) = pHashKey;
+		if (nnueEnabled)
+			update_accumulator(pos, move, ply);
 		return;
 	}
 
@@ -289,11 +303,9 @@ make_move(position_t *pos, move_t move, int ply)
 	else
 		Pieces(BLACK) ^= toMask;
 	Occupied    ^= toMask;
-	Occupied90L ^= Mask90L(to);
-	Occupied45L ^= Mask45L(to);
-	Occupied45R ^= Mask45R(to);
 	HalfmoveClock(newply) = 0;
 	Material(newply, opp) -= PieceValue(cap);
+	remove_psq(pos, newply, cap, to);
 	hashKey ^= Zobrist(cap, to);
 
 	switch (PieceType(cap)) {
@@ -315,16 +327,16 @@ make_move(position_t *pos, move_t move, int ply)
 		MajorCount(newply, opp)--;
 		switch (to) {
 		case H1:
-			hashKey = change_castling(newply, hashKey, ~WHITE_CAN_CASTLE_KS);
+			hashKey = change_castling(pos, newply, hashKey, ~WHITE_CAN_CASTLE_KS);
 			break;
 		case A1:
-			hashKey = change_castling(newply, hashKey, ~WHITE_CAN_CASTLE_QS);
+			hashKey = change_castling(pos, newply, hashKey, ~WHITE_CAN_CASTLE_QS);
 			break;
 		case H8:
-			hashKey = change_castling(newply, hashKey, ~BLACK_CAN_CASTLE_KS);
+			hashKey = change_castling(pos, newply, hashKey, ~BLACK_CAN_CASTLE_KS);
 			break;
 		case A8:
-			hashKey = change_castling(newply, hashKey, ~BLACK_CAN_CASTLE_QS);
+			hashKey = change_castling(pos, newply, hashKey, ~BLACK_CAN_CASTLE_QS);
 			break;
 		}
 		break;
@@ -336,6 +348,43 @@ make_move(position_t *pos, move_t move, int ply)
 
 	HashKey(newply) = hashKey;
 	PawnHashKey(newply) = pHashKey;
+	if (nnueEnabled)
+		update_accumulator(pos, move, ply);
+}
+
+///////////////////////////////
+// passes the turn to the other side, for null move pruning. nothing
+// moves, so only the state changes: the side to move, the en passant
+// square and the hash key. the halfmove clock is reset as well, so
+// that the repetition check doesn't look back past the null move.
+// with a network loaded, its accumulator is carried over unchanged.
+///////////////////////////////
+void
+make_null_move(position_t *pos, int ply)
+{
+	uint8 newply = ply + 1;
+
+	State(newply) = State(ply);
+	Stm(newply) ^= 1;
+	EpSquare(newply) = INVALID_SQUARE;
+	HalfmoveClock(newply) = 0;
+
+	HashKey(newply) ^= ZobristStm;
+	if (EpSquare(ply) != INVALID_SQUARE)
+		HashKey(newply) ^= ZobristEp(EpSquare(ply));
+	if (nnueEnabled)
+		Accumulator(newply) = Accumulator(ply);
+}
+
+///////////////////////////////
+// takes back a null move. the board was never touched, and the state
+// of the ply before is still on the stack, so there's nothing to do.
+// it's here to pair with make_null_move, as unmake_move does with
+// make_move.
+///////////////////////////////
+void
+unmake_null_move(position_t *pos, int ply)
+{
 }
 
 ///////////////////////////////
@@ -361,9 +410,6 @@ unmake_move(position_t *pos, move_t move, int ply)
 	else
 		Pieces(BLACK) ^= moveMask;
 	Occupied     ^= moveMask;
-	Occupied90L  ^= Mask90L(from) | Mask90L(to);
-	Occupied45L  ^= Mask45L(from) | Mask45L(to);
-	Occupied45R  ^= Mask45R(from) | Mask45R(to);
 	PieceOn(from) = pc;
 	PieceOn(to)   = EMPTY;
 
@@ -384,9 +430,6 @@ unmake_move(position_t *pos, move_t move, int ply)
 			Pieces(opp)    ^= capMask;
 			Pawns(opp)     ^= capMask;
 			Occupied       ^= capMask;
-			Occupied90L    ^= Mask90L(capsq);
-			Occupied45L    ^= Mask45L(capsq);
-			Occupied45R    ^= Mask45R(capsq);
 			PieceOn(capsq)  = MakePiece(PAWN, opp);
 
 			// clear so we don't bother with this later
@@ -412,25 +455,19 @@ unmake_move(position_t *pos, move_t move, int ply)
 
 			if (IsCastle(move)) {
 				if (to == G1) {
-					// constants = Mask{00L,90L,...} H1 | F1
+					// constant = Mask(H1) | Mask(F1)
 					uint64 rookMoveMask = 0xa0;
 					Pieces(WHITE) ^= rookMoveMask;
 					Rooks(WHITE)  ^= rookMoveMask;
 					Occupied      ^= rookMoveMask;
-					Occupied90L   ^= ULL(0x8000800000000000);
-					Occupied45L   ^= ULL(0x800100000);
-					Occupied45R   ^= ULL(0x9);
 					PieceOn(H1)    = WROOK;
 					PieceOn(F1)    = EMPTY;
 				} else if (to == C1) {
-					// constants = Mask{00L,90L,...} A1 | D1
+					// constant = Mask(A1) | Mask(D1)
 					uint64 rookMoveMask = ULL(0x9);
 					Pieces(WHITE) ^= rookMoveMask;
 					Rooks(WHITE)  ^= rookMoveMask;
 					Occupied      ^= rookMoveMask;
-					Occupied90L   ^= ULL(0x80000080);
-					Occupied45L   ^= ULL(0x201);
-					Occupied45R   ^= ULL(0x10000400);
 					PieceOn(A1)    = WROOK;
 					PieceOn(D1)    = EMPTY;
 				}
@@ -441,25 +478,19 @@ unmake_move(position_t *pos, move_t move, int ply)
 
 			if (IsCastle(move)) {
 				if (to == G8) {
-					// constants = Mask{00L,90L,...} H8 | F8
+					// constant = Mask(H8) | Mask(F8)
 					uint64 rookMoveMask = ULL(0xa000000000000000);
 					Pieces(BLACK) ^= rookMoveMask;
 					Rooks(BLACK)  ^= rookMoveMask;
 					Occupied      ^= rookMoveMask;
-					Occupied90L   ^= ULL(0x100010000000000);
-					Occupied45L   ^= ULL(0x8400000000000000);
-					Occupied45R   ^= ULL(0x1000800000000);
 					PieceOn(H8)    = BROOK;
 					PieceOn(F8)    = EMPTY;
 				} else if (to == C8) {
-					// constants = Mask{00L,90L,...} A8 | D8
+					// constant = Mask(A8) | Mask(D8)
 					uint64 rookMoveMask = ULL(0x900000000000000);
 					Pieces(BLACK) ^= rookMoveMask;
 					Rooks(BLACK)  ^= rookMoveMask;
 					Occupied      ^= rookMoveMask;
-					Occupied90L   ^= ULL(0x1000001);
-					Occupied45L   ^= ULL(0x2000010000000);
-					Occupied45R   ^= ULL(0x8200000000000000);
 					PieceOn(A8)    = BROOK;
 					PieceOn(D8)    = EMPTY;
 				}
@@ -479,9 +510,6 @@ unmake_move(position_t *pos, move_t move, int ply)
 	else
 		Pieces(BLACK) ^= toMask;
 	Occupied    ^= toMask;
-	Occupied90L ^= Mask90L(to);
-	Occupied45L ^= Mask45L(to);
-	Occupied45R ^= Mask45R(to);
 	PieceOn(to)  = cap;
 
 	switch (PieceType(cap)) {
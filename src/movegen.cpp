@@ -1,14 +1,39 @@
 #include "benthos.h"
 
-static scored_move_t *generate_captures_of(const position_t *, scored_move_t *, uint8, uint8, int);
-static scored_move_t *generate_blocks(const position_t *, scored_move_t *, uint8, uint8, uint8, int);
-static scored_move_t *generate_pawn_captures(const position_t *, scored_move_t *, uint8, uint8, int);
-static scored_move_t *generate_pawn_moves(const position_t *, scored_move_t *, uint8, uint8, int);
-static scored_move_t *generate_piece_moves(const position_t *, scored_move_t *, uint8, uint8, int);
+static scored_move_t *generate_captures_of(const position_t *, scored_move_t *, uint8, uint8, bitboard_t, int);
+static scored_move_t *generate_blocks(const position_t *, scored_move_t *, uint8, uint8, uint8, bitboard_t, int);
+static scored_move_t *generate_pawn_captures(const position_t *, scored_move_t *, uint8, uint8, bitboard_t, int);
+static scored_move_t *generate_pawn_moves(const position_t *, scored_move_t *, uint8, uint8, bitboard_t, int);
+static scored_move_t *generate_piece_moves(const position_t *, scored_move_t *, uint8, uint8, bitboard_t, int);
+static inline bool    ep_is_legal(const position_t *, uint8, uint8, uint8);
 
 ///////////////////////////////
-// generates pseudo-legal noncaptures from the provided position, using
-// the state information at the specified ply. the moves are appended to
+// all of the generators below produce strictly legal moves. pieces
+// pinned to their king are only allowed to move along the pin line,
+// king moves are tested with the king lifted off the board, and en
+// passant captures get a full test, as they remove two pieces from
+// a line at once. captures and noncaptures are only valid when the
+// side to move is not in check; otherwise use generate_evasions.
+///////////////////////////////
+
+///////////////////////////////
+// generates all legal moves from the provided position, using the
+// state information at the specified ply. the moves are appended to
+// the scored_move_t pointer, and the incremented pointer is returned.
+///////////////////////////////
+scored_move_t *
+generate_moves(const position_t *pos, scored_move_t *moves, int ply)
+{
+	if (Checked(Stm(ply)))
+		return generate_evasions(pos, moves, ply);
+
+	moves = generate_captures(pos, moves, ply);
+	return generate_noncaptures(pos, moves, ply);
+}
+
+///////////////////////////////
+// generates legal captures from the provided position, using the
+// state information at the specified ply. the moves are appended to
 // the scored_move_t pointer, and the incremented pointer is returned.
 ///////////////////////////////
 scored_move_t *
@@ -16,9 +41,11 @@ generate_captures(const position_t *pos, scored_move_t *moves, int ply)
 {
 	uint8  stm  = Stm(ply);
 	uint8  epsq = EpSquare(ply);
+	uint8  ksq  = KingSq(stm);
 	uint8  from, to;
 	uint8  pc;
 	bitboard_t targets = Pieces(stm^1);
+	bitboard_t pinned  = pinned_pieces(pos, stm);
 	bitboard_t pieces, dests;
 	bitboard_t epmask = 0;
 	move_t tmpmv;
@@ -31,6 +58,8 @@ generate_captures(const position_t *pos, scored_move_t *moves, int ply)
 		while (pieces) {
 			from = poplsb(pieces);
 			dests = WhitePawnAttacks(from) & targets;
+			if (Mask(from) & pinned)
+				dests &= LineThrough(ksq, from);
 			tmpmv = from | (WPAWN << 12);
 			while (dests) {
 				to = poplsb(dests);
@@ -45,13 +74,15 @@ generate_captures(const position_t *pos, scored_move_t *moves, int ply)
 					(moves++)->move = tmpmv | (to << 6) | (PieceOn(to) << 16);
 			}
 
-			if (WhitePawnAttacks(from) & epmask)
+			if ((WhitePawnAttacks(from) & epmask) && ep_is_legal(pos, from, epsq, stm))
 				(moves++)->move = tmpmv | (epsq << 6) | (BPAWN << 16) | ENPASSANTMASK;
 		}
 	} else {
 		while (pieces) {
 			from = poplsb(pieces);
 			dests = BlackPawnAttacks(from) & targets;
+			if (Mask(from) & pinned)
+				dests &= LineThrough(ksq, from);
 			tmpmv = from | (BPAWN << 12);
 			while (dests) {
 				to = poplsb(dests);
@@ -66,12 +97,12 @@ generate_captures(const position_t *pos, scored_move_t *moves, int ply)
 					(moves++)->move = tmpmv | (to << 6) | (PieceOn(to) << 16);
 			}
 
-			if (BlackPawnAttacks(from) & epmask)
+			if ((BlackPawnAttacks(from) & epmask) && ep_is_legal(pos, from, epsq, stm))
 				(moves++)->move = tmpmv | (epsq << 6) | (WPAWN << 16) | ENPASSANTMASK;
 		}
 	}
 
-	pieces = Knights(stm);
+	pieces = Knights(stm) & ~pinned;
 	pc = MakePiece(KNIGHT, stm);
 	while (pieces) {
 		from = poplsb(pieces);
@@ -89,6 +120,8 @@ generate_captures(const position_t *pos, scored_move_t *moves, int ply)
 		from = poplsb(pieces);
 		tmpmv = from | (pc << 12);
 		dests = BishopMoves(from) & targets;
+		if (Mask(from) & pinned)
+			dests &= LineThrough(ksq, from);
 		while (dests) {
 			to = poplsb(dests);
 			(moves++)->move = tmpmv | (to << 6) | (PieceOn(to) << 16);
@@ -101,6 +134,8 @@ generate_captures(const position_t *pos, scored_move_t *moves, int ply)
 		from = poplsb(pieces);
 		tmpmv = from | (pc << 12);
 		dests = RookMoves(from) & targets;
+		if (Mask(from) & pinned)
+			dests &= LineThrough(ksq, from);
 		while (dests) {
 			to = poplsb(dests);
 			(moves++)->move = tmpmv | (to << 6) | (PieceOn(to) << 16);
@@ -113,6 +148,8 @@ generate_captures(const position_t *pos, scored_move_t *moves, int ply)
 		from = poplsb(pieces);
 		tmpmv = from | (pc << 12);
 		dests = QueenMoves(from) & targets;
+		if (Mask(from) & pinned)
+			dests &= LineThrough(ksq, from);
 		while (dests) {
 			to = poplsb(dests);
 			(moves++)->move = tmpmv | (to << 6) | (PieceOn(to) << 16);
@@ -125,24 +162,27 @@ generate_captures(const position_t *pos, scored_move_t *moves, int ply)
 	dests = KingMoves(from) & targets;
 	while (dests) {
 		to = poplsb(dests);
-		(moves++)->move = tmpmv | (to << 6) | (PieceOn(to) << 16);
+		if (!attacked_through(pos, to, stm^1, Occupied ^ Mask(from)))
+			(moves++)->move = tmpmv | (to << 6) | (PieceOn(to) << 16);
 	}
 
 	return moves;
 }
 
 ///////////////////////////////
-// generates pseudo-legal noncaptures from the provided position, using
-// the state information at the specified ply. the moves are appended to
+// generates legal noncaptures from the provided position, using the
+// state information at the specified ply. the moves are appended to
 // the scored_move_t pointer, and the incremented pointer is returned.
 ///////////////////////////////
 scored_move_t *
 generate_noncaptures(const position_t *pos, scored_move_t *moves, int ply)
 {
 	uint8 stm = Stm(ply);
+	uint8 ksq = KingSq(stm);
 	uint8 from, to;
 	uint8 pc;
 	bitboard_t targets = ~Occupied;
+	bitboard_t pinned  = pinned_pieces(pos, stm);
 	bitboard_t pieces, dests;
 	move_t tmpmv;
 
@@ -168,6 +208,8 @@ generate_noncaptures(const position_t *pos, scored_move_t *moves, int ply)
 			to = from + 8;
 			if (Occupied & Mask(to))
 				continue;
+			if ((Mask(from) & pinned) && !(LineThrough(ksq, from) & Mask(to)))
+				continue;
 			if (Rank(from) == RANK2 && !(Occupied & Mask(to + 8))) {
 				(moves++)->move = tmpmv | ((to + 8) << 6) | PAWNJUMPMASK;
 				(moves++)->move = tmpmv | (to << 6);
@@ -188,6 +230,8 @@ generate_noncaptures(const position_t *pos, scored_move_t *moves, int ply)
 			to = from - 8;
 			if (Occupied & Mask(to))
 				continue;
+			if ((Mask(from) & pinned) && !(LineThrough(ksq, from) & Mask(to)))
+				continue;
 			if (Rank(from) == RANK7 && !(Occupied & Mask(to - 8))) {
 				(moves++)->move = tmpmv | ((to - 8) << 6) | PAWNJUMPMASK;
 				(moves++)->move = tmpmv | (to << 6);
@@ -202,7 +246,7 @@ generate_noncaptures(const position_t *pos, scored_move_t *moves, int ply)
 		}
 	}
 
-	pieces = Knights(stm);
+	pieces = Knights(stm) & ~pinned;
 	pc = MakePiece(KNIGHT, stm);
 	while (pieces) {
 		from = poplsb(pieces);
@@ -220,6 +264,8 @@ generate_noncaptures(const position_t *pos, scored_move_t *moves, int ply)
 		from = poplsb(pieces);
 		tmpmv = from | (pc << 12);
 		dests = BishopMoves(from) & targets;
+		if (Mask(from) & pinned)
+			dests &= LineThrough(ksq, from);
 		while (dests) {
 			to = poplsb(dests);
 			(moves++)->move = tmpmv | (to << 6);
@@ -232,6 +278,8 @@ generate_noncaptures(const position_t *pos, scored_move_t *moves, int ply)
 		from = poplsb(pieces);
 		tmpmv = from | (pc << 12);
 		dests = RookMoves(from) & targets;
+		if (Mask(from) & pinned)
+			dests &= LineThrough(ksq, from);
 		while (dests) {
 			to = poplsb(dests);
 			(moves++)->move = tmpmv | (to << 6);
@@ -244,6 +292,8 @@ generate_noncaptures(const position_t *pos, scored_move_t *moves, int ply)
 		from = poplsb(pieces);
 		tmpmv = from | (pc << 12);
 		dests = QueenMoves(from) & targets;
+		if (Mask(from) & pinned)
+			dests &= LineThrough(ksq, from);
 		while (dests) {
 			to = poplsb(dests);
 			(moves++)->move = tmpmv | (to << 6);
@@ -256,16 +306,94 @@ generate_noncaptures(const position_t *pos, scored_move_t *moves, int ply)
 	dests = KingMoves(from) & targets;
 	while (dests) {
 		to = poplsb(dests);
-		(moves++)->move = tmpmv | (to << 6);
+		if (!attacked_through(pos, to, stm^1, Occupied ^ Mask(from)))
+			(moves++)->move = tmpmv | (to << 6);
 	}
 
 	return moves;
 }
 
 ///////////////////////////////
-// generates pseudolegal check evasions. this is presumably
-// faster than generating all normal moves when most are useless,
-// but my code is somewhat dirty, so it might not be.
+// tells whether a move found elsewhere in the tree, such as a killer,
+// is one of the legal noncaptures generate_noncaptures would give for
+// the position at the specified ply. the move is rebuilt from its
+// squares and compared whole, so one that passes can be played as is.
+// as with the generator, the side to move must not be in check.
+///////////////////////////////
+bool
+is_legal_noncapture(const position_t *pos, move_t mv, int ply)
+{
+	uint8 stm = Stm(ply);
+	uint8 ksq = KingSq(stm);
+	uint8 from = From(mv), to = To(mv);
+	uint8 pc = PieceOn(from);
+	bitboard_t dests;
+	move_t expected = from | (to << 6) | (pc << 12);
+
+	if (IsCastle(mv)) {
+		if (stm == WHITE)
+			return (mv == MOVE_WHITE_OO && CanWhiteKS(ply))
+				|| (mv == MOVE_WHITE_OOO && CanWhiteQS(ply));
+		return (mv == MOVE_BLACK_OO && CanBlackKS(ply))
+			|| (mv == MOVE_BLACK_OOO && CanBlackQS(ply));
+	}
+
+	if (pc == EMPTY || PieceColor(pc) != stm || (Occupied & Mask(to)))
+		return false;
+
+	switch (PieceType(pc)) {
+	case PAWN: {
+		int push = stm == WHITE ? 8 : -8;
+		uint8 promote = Promote(mv);
+		if (to == from + 2 * push && Rank(from) == (stm == WHITE ? RANK2 : RANK7)
+				&& !(Occupied & Mask(from + push)))
+			expected |= PAWNJUMPMASK;
+		else if (to != from + push)
+			return false;
+		else if (Rank(to) == (stm == WHITE ? RANK8 : RANK1)) {
+			if (promote != MakePiece(QUEEN, stm) && promote != MakePiece(KNIGHT, stm)
+					&& promote != MakePiece(ROOK, stm) && promote != MakePiece(BISHOP, stm))
+				return false;
+			expected |= promote << 20;
+		}
+		dests = Mask(to);
+		break;
+	}
+	case KNIGHT:
+		dests = KnightMoves(from);
+		break;
+	case BISHOP:
+		dests = BishopMoves(from);
+		break;
+	case ROOK:
+		dests = RookMoves(from);
+		break;
+	case QUEEN:
+		dests = QueenMoves(from);
+		break;
+	case KING:
+		return mv == expected && (KingMoves(from) & Mask(to))
+			&& !attacked_through(pos, to, stm^1, Occupied ^ Mask(from));
+	default:
+		return false;
+	}
+
+	if (mv != expected || !(dests & Mask(to)))
+		return false;
+
+	// a pinned piece has to stay on the pin line, which a knight can't
+	if (Mask(from) & pinned_pieces(pos, stm))
+		return (LineThrough(ksq, from) & Mask(to)) != 0;
+	return true;
+}
+
+///////////////////////////////
+// generates legal check evasions. this is presumably faster than
+// generating all normal moves when most are useless, but my code is
+// somewhat dirty, so it might not be.
+//
+// pinned pieces never take part in an evasion: they can't leave the
+// pin line, and neither the checker nor the check ray lie on it.
 ///////////////////////////////
 scored_move_t *
 generate_evasions(const position_t *pos, scored_move_t *moves, int ply)
@@ -274,17 +402,19 @@ generate_evasions(const position_t *pos, scored_move_t *moves, int ply)
 	uint8 opp = stm^1;
 	uint8 ksq = KingSq(stm);
 	bitboard_t attackers = attacks_to(pos, ksq) & Pieces(opp);
+	bitboard_t movers;
 	uint8 pc, to;
 	bitboard_t dests;
 	move_t tmpmv;
 
-	// first generate standard king moves
+	// first generate standard king moves. the king is lifted off the
+	// board, so it can't step back along the line of a sliding check.
 	dests = KingMoves(ksq) & ~Pieces(stm);
 	pc = MakePiece(KING, stm);
 	tmpmv = ksq | (pc << 12);
 	while (dests) {
 		to = poplsb(dests);
-		if (AttackedBy(opp, to))
+		if (attacked_through(pos, to, opp, Occupied ^ Mask(ksq)))
 			continue;
 
 		pc = PieceOn(to);
@@ -299,40 +429,42 @@ generate_evasions(const position_t *pos, scored_move_t *moves, int ply)
 		return moves;
 
 	// capture or block the attacking piece.
+	movers = Pieces(stm) & ~pinned_pieces(pos, stm);
 	to = lsb(attackers);
-	moves = generate_captures_of(pos, moves, to, stm, ply);
+	moves = generate_captures_of(pos, moves, to, stm, movers, ply);
 	if (Slides(PieceOn(to)))
-		moves = generate_blocks(pos, moves, to, ksq, stm, ply);
+		moves = generate_blocks(pos, moves, to, ksq, stm, movers, ply);
 
 	return moves;
 }
 
 ///////////////////////////////
 // helper function for generate_evasions. generates captures of the piece
-// on a given square by the specified side to move.
+// on a given square by the specified side to move, using only the pieces
+// in movers.
 ///////////////////////////////
 static scored_move_t *
-generate_captures_of(const position_t *pos, scored_move_t *moves, uint8 sq, uint8 stm, int ply)
+generate_captures_of(const position_t *pos, scored_move_t *moves, uint8 sq, uint8 stm, bitboard_t movers, int ply)
 {
-	moves = generate_pawn_captures(pos, moves, sq, stm, ply);
-	return generate_piece_moves(pos, moves, sq, stm, ply);
+	moves = generate_pawn_captures(pos, moves, sq, stm, movers, ply);
+	return generate_piece_moves(pos, moves, sq, stm, movers, ply);
 }
 
 ///////////////////////////////
 // helper function for generate_evasions. generates moves that will block
-// a sliding attack from sq1 to sq2, by any piece but a king of the specified
-// side to move.
+// a sliding attack from sq1 to sq2, by any piece in movers but a king of
+// the specified side to move.
 ///////////////////////////////
 static scored_move_t *
-generate_blocks(const position_t *pos, scored_move_t *moves, uint8 sq1, uint8 sq2, uint8 stm, int ply)
+generate_blocks(const position_t *pos, scored_move_t *moves, uint8 sq1, uint8 sq2, uint8 stm, bitboard_t movers, int ply)
 {
 	uint8 to;
 	bitboard_t ray = RayBetween(sq1, sq2);
 
 	while (ray) {
 		to = poplsb(ray);
-		moves = generate_pawn_moves(pos, moves, to, stm, ply);
-		moves = generate_piece_moves(pos, moves, to, stm, ply);
+		moves = generate_pawn_moves(pos, moves, to, stm, movers, ply);
+		moves = generate_piece_moves(pos, moves, to, stm, movers, ply);
 	}
 
 	return moves;
@@ -340,16 +472,16 @@ generate_blocks(const position_t *pos, scored_move_t *moves, uint8 sq1, uint8 sq
 
 ///////////////////////////////
 // helper function for generate_evasions. generates captures of the piece
-// on a given square by the pawns of the specified side to move.
+// on a given square by the pawns in movers of the specified side to move.
 ///////////////////////////////
 static scored_move_t *
-generate_pawn_captures(const position_t *pos, scored_move_t *moves, uint8 sq, uint8 stm, int ply)
+generate_pawn_captures(const position_t *pos, scored_move_t *moves, uint8 sq, uint8 stm, bitboard_t movers, int ply)
 {
 	uint8 cappc = PieceOn(sq);
 	uint8 epsq  = EpSquare(ply);
 	uint8 from;
 	bitboard_t target = Mask(sq);
-	bitboard_t pieces = attacks_to(pos, sq) & Pawns(stm);
+	bitboard_t pieces = attacks_to(pos, sq) & Pawns(stm) & movers;
 	move_t tmpmv;
 
 	if (stm == WHITE) {
@@ -370,16 +502,11 @@ generate_pawn_captures(const position_t *pos, scored_move_t *moves, uint8 sq, ui
 
 		// special case afterwards: try to capture with en passant
 		if (cappc == BPAWN && sq == epsq - 8) {
-			bitboard_t mask = 0;
-			if (Distance(epsq, epsq - 9) == 1)
-				mask |= Mask(epsq - 9);
-			if (Distance(epsq, epsq - 7) == 1)
-				mask |= Mask(epsq - 7);
-
-			pieces = Pawns(stm) & mask;
+			pieces = BlackPawnAttacks(epsq) & Pawns(stm) & movers;
 			while (pieces) {
 				from = poplsb(pieces);
-				(moves++)->move = from | (epsq << 6) | (WPAWN << 12) | (BPAWN << 12) | ENPASSANTMASK;
+				if (ep_is_legal(pos, from, epsq, stm))
+					(moves++)->move = from | (epsq << 6) | (WPAWN << 12) | (BPAWN << 16) | ENPASSANTMASK;
 			}
 		}
 	} else {
@@ -400,16 +527,11 @@ generate_pawn_captures(const position_t *pos, scored_move_t *moves, uint8 sq, ui
 
 		// special case afterwards: try to capture with en passant
 		if (cappc == WPAWN && sq == epsq + 8) {
-			bitboard_t mask = 0;
-			if (Distance(epsq, epsq + 9) == 1)
-				mask |= Mask(epsq + 9);
-			if (Distance(epsq, epsq + 7) == 1)
-				mask |= Mask(epsq + 7);
-
-			pieces = Pawns(stm) & mask;
+			pieces = WhitePawnAttacks(epsq) & Pawns(stm) & movers;
 			while (pieces) {
 				from = poplsb(pieces);
-				(moves++)->move = from | (epsq << 6) | (BPAWN << 12) | (WPAWN << 12) | ENPASSANTMASK;
+				if (ep_is_legal(pos, from, epsq, stm))
+					(moves++)->move = from | (epsq << 6) | (BPAWN << 12) | (WPAWN << 16) | ENPASSANTMASK;
 			}
 		}
 	}
@@ -419,14 +541,15 @@ generate_pawn_captures(const position_t *pos, scored_move_t *moves, uint8 sq, ui
 
 ///////////////////////////////
 // helper function for generate_evasions. generates non-capturing
-// moves to a given square by pawns of the specified side to move.
+// moves to a given square by the pawns in movers of the specified
+// side to move.
 ///////////////////////////////
 static scored_move_t *
-generate_pawn_moves(const position_t *pos, scored_move_t *moves, uint8 sq, uint8 stm, int ply)
+generate_pawn_moves(const position_t *pos, scored_move_t *moves, uint8 sq, uint8 stm, bitboard_t movers, int ply)
 {
 	uint8 epsq = EpSquare(ply);
 	uint8 from;
-	bitboard_t pieces = Pawns(stm);
+	bitboard_t pieces = Pawns(stm) & movers;
 	move_t tmpmv;
 
 	if (stm == WHITE) {
@@ -448,16 +571,11 @@ generate_pawn_moves(const position_t *pos, scored_move_t *moves, uint8 sq, uint8
 		}
 
 		if (sq == epsq) {
-			bitboard_t mask = 0;
-			if (Distance(epsq, epsq - 9) == 1)
-				mask |= Mask(epsq - 9);
-			if (Distance(epsq, epsq - 7) == 1)
-				mask |= Mask(epsq - 7);
-
-			pieces = Pawns(stm) & mask;
+			pieces = BlackPawnAttacks(epsq) & Pawns(stm) & movers;
 			while (pieces) {
 				from = poplsb(pieces);
-				(moves++)->move = from | (epsq << 6) | (WPAWN << 12) | (BPAWN << 16) | ENPASSANTMASK;
+				if (ep_is_legal(pos, from, epsq, stm))
+					(moves++)->move = from | (epsq << 6) | (WPAWN << 12) | (BPAWN << 16) | ENPASSANTMASK;
 			}
 		}
 	} else {
@@ -467,7 +585,7 @@ generate_pawn_moves(const position_t *pos, scored_move_t *moves, uint8 sq, uint8
 			if (from == sq + 8) {
 				tmpmv = from | (sq << 6) | (BPAWN << 12);
 
-				if (Rank(sq) == RANK8) {
+				if (Rank(sq) == RANK1) {
 					(moves++)->move = tmpmv | (BQUEEN  << 20);
 					(moves++)->move = tmpmv | (BKNIGHT << 20);
 					(moves++)->move = tmpmv | (BROOK   << 20);
@@ -479,16 +597,11 @@ generate_pawn_moves(const position_t *pos, scored_move_t *moves, uint8 sq, uint8
 		}
 
 		if (sq == epsq) {
-			bitboard_t mask = 0;
-			if (Distance(epsq, epsq + 9) == 1)
-				mask |= Mask(epsq + 9);
-			if (Distance(epsq, epsq + 7) == 1)
-				mask |= Mask(epsq + 7);
-
-			pieces = Pawns(stm) & mask;
+			pieces = WhitePawnAttacks(epsq) & Pawns(stm) & movers;
 			while (pieces) {
 				from = poplsb(pieces);
-				(moves++)->move = from | (epsq << 6) | (BPAWN << 12) | (WPAWN << 16) | ENPASSANTMASK;
+				if (ep_is_legal(pos, from, epsq, stm))
+					(moves++)->move = from | (epsq << 6) | (BPAWN << 12) | (WPAWN << 16) | ENPASSANTMASK;
 			}
 		}
 	}
@@ -498,14 +611,14 @@ generate_pawn_moves(const position_t *pos, scored_move_t *moves, uint8 sq, uint8
 
 ///////////////////////////////
 // helper function for generate_evasions. generates moves to a given
-// square by all pieces except pawns or the king.
+// square by all pieces in movers except pawns or the king.
 ///////////////////////////////
 static scored_move_t *
-generate_piece_moves(const position_t *pos, scored_move_t *moves, uint8 sq, uint8 stm, int ply)
+generate_piece_moves(const position_t *pos, scored_move_t *moves, uint8 sq, uint8 stm, bitboard_t movers, int ply)
 {
 	uint8 cappc = PieceOn(sq);
 	uint8 from, pc;
-	bitboard_t attackers = attacks_to(pos, sq) & Pieces(stm);
+	bitboard_t attackers = attacks_to(pos, sq) & movers;
 	bitboard_t pieces;
 	move_t tmpmv = (sq << 6) | (cappc << 16);
 
@@ -539,3 +652,18 @@ generate_piece_moves(const position_t *pos, scored_move_t *moves, uint8 sq, uint
 
 	return moves;
 }
+
+///////////////////////////////
+// determines if an en passant capture by the pawn on from leaves the
+// king of the side to move safe. both pawns leave the board and the
+// capturing pawn lands on the en passant square, so this is the one
+// case where a pin along the rank can't be found ahead of time.
+///////////////////////////////
+static inline bool
+ep_is_legal(const position_t *pos, uint8 from, uint8 epsq, uint8 stm)
+{
+	uint8 capsq = stm == WHITE ? epsq - 8 : epsq + 8;
+	bitboard_t occ = (Occupied ^ Mask(from) ^ Mask(capsq)) | Mask(epsq);
+
+	return !attacked_through(pos, KingSq(stm), stm^1, occ);
+}
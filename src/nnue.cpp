@@ -0,0 +1,323 @@
+#include "benthos.h"
+#include <cstring>
+#include "nnue.h"
+
+#if defined(USE_AVX2) || defined(USE_SSE2)
+#include <immintrin.h>
+#endif
+
+///////////////////////////////
+// an efficiently updatable neural network, used in place of the
+// classical evaluation once a weights file is loaded. see nnue.h for
+// the layout of the network.
+//
+// the hidden layer is a sum of the weight rows of the inputs that are
+// set, so a move only has to add and subtract the rows of the pieces
+// it moves. make_move does that, from the accumulator of the ply
+// before into the ply's own, and as with the state stack there's
+// nothing to undo. only a king crossing into another bucket changes
+// every input of its side, and that side is summed up from scratch.
+///////////////////////////////
+
+bool nnueEnabled = false;
+
+static int16 *featureWeights = NULL;
+static int16  featureBiases[NNUE_HIDDEN];
+static int16  outputWeights[2 * NNUE_HIDDEN];
+static int16  outputBias;
+
+// input offsets by piece type, for pieces of the side itself. the
+// other side's follow 5 * 64 on. kings have none.
+static const int pieceOffsets[8] = { -1, 0, 64, -1, -1, 128, 192, 256 };
+
+// by the square of the king, from its own side
+static const int kingBuckets[64] = {
+	0, 0, 1, 1, 2, 2, 3, 3,
+	4, 4, 4, 4, 5, 5, 5, 5,
+	6, 6, 6, 6, 7, 7, 7, 7,
+	6, 6, 6, 6, 7, 7, 7, 7,
+	6, 6, 6, 6, 7, 7, 7, 7,
+	6, 6, 6, 6, 7, 7, 7, 7,
+	6, 6, 6, 6, 7, 7, 7, 7,
+	6, 6, 6, 6, 7, 7, 7, 7,
+};
+
+// black sees the board flipped, so both sides' inputs are alike
+#define Orient(side, sq)   ((side) == WHITE ? (sq) : (sq) ^ 56)
+#define KingBucket(side, ksq) (kingBuckets[Orient(side, ksq)])
+#define Feature(side, bucket, pc, sq) \
+	((bucket) * NNUE_PIECES * 64 + (PieceColor(pc) != (side)) * 5 * 64 \
+	 + pieceOffsets[PieceType(pc)] + Orient(side, sq))
+#define FeatureRow(f)      (featureWeights + (f) * NNUE_HIDDEN)
+
+///////////////////////////////
+// the kernels. one pass over the hidden layer copies the accumulator
+// of the ply before while adding and subtracting the changed rows, so
+// each neuron is loaded and stored only once.
+///////////////////////////////
+#if defined(USE_AVX2)
+typedef __m256i vec_t;
+#define VEC_WIDTH       16
+#define vec_load(p)     _mm256_loadu_si256((const __m256i *)(p))
+#define vec_store(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define vec_add(a, b)   _mm256_add_epi16(a, b)
+#define vec_sub(a, b)   _mm256_sub_epi16(a, b)
+#define vec_clamp(v)    _mm256_min_epi16(_mm256_max_epi16(v, _mm256_setzero_si256()), _mm256_set1_epi16(NNUE_QA))
+#define vec_madd(a, b)  _mm256_madd_epi16(a, b)
+#define vec_add32(a, b) _mm256_add_epi32(a, b)
+#define vec_zero()      _mm256_setzero_si256()
+
+static inline int
+vec_sum32(vec_t v)
+{
+	__m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+	return _mm_cvtsi128_si32(s);
+}
+#elif defined(USE_SSE2)
+typedef __m128i vec_t;
+#define VEC_WIDTH       8
+#define vec_load(p)     _mm_loadu_si128((const __m128i *)(p))
+#define vec_store(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define vec_add(a, b)   _mm_add_epi16(a, b)
+#define vec_sub(a, b)   _mm_sub_epi16(a, b)
+#define vec_clamp(v)    _mm_min_epi16(_mm_max_epi16(v, _mm_setzero_si128()), _mm_set1_epi16(NNUE_QA))
+#define vec_madd(a, b)  _mm_madd_epi16(a, b)
+#define vec_add32(a, b) _mm_add_epi32(a, b)
+#define vec_zero()      _mm_setzero_si128()
+
+static inline int
+vec_sum32(vec_t v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0x4e));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0xb1));
+	return _mm_cvtsi128_si32(v);
+}
+#endif
+
+static inline void
+apply_rows(int16 *dst, const int16 *src, const int *adds, int addCount, const int *subs, int subCount)
+{
+#ifdef VEC_WIDTH
+	for (int i = 0; i < NNUE_HIDDEN; i += VEC_WIDTH) {
+		vec_t v = vec_load(src + i);
+		for (int a = 0; a < addCount; a++)
+			v = vec_add(v, vec_load(FeatureRow(adds[a]) + i));
+		for (int s = 0; s < subCount; s++)
+			v = vec_sub(v, vec_load(FeatureRow(subs[s]) + i));
+		vec_store(dst + i, v);
+	}
+#else
+	// a row at a time, in loops simple enough for the compiler to
+	// vectorize by itself
+	if (dst != src)
+		memcpy(dst, src, NNUE_HIDDEN * sizeof(int16));
+	for (int a = 0; a < addCount; a++) {
+		const int16 *row = FeatureRow(adds[a]);
+		for (int i = 0; i < NNUE_HIDDEN; i++)
+			dst[i] += row[i];
+	}
+	for (int s = 0; s < subCount; s++) {
+		const int16 *row = FeatureRow(subs[s]);
+		for (int i = 0; i < NNUE_HIDDEN; i++)
+			dst[i] -= row[i];
+	}
+#endif
+}
+
+// the clipped hidden layer of one side, dotted with its output weights
+static inline int
+output_sum(const int16 *values, const int16 *weights)
+{
+#ifdef VEC_WIDTH
+	vec_t sum = vec_zero();
+	for (int i = 0; i < NNUE_HIDDEN; i += VEC_WIDTH)
+		sum = vec_add32(sum, vec_madd(vec_clamp(vec_load(values + i)), vec_load(weights + i)));
+	return vec_sum32(sum);
+#else
+	int sum = 0;
+	for (int i = 0; i < NNUE_HIDDEN; i++)
+		sum += Min(Max((int)values[i], 0), NNUE_QA) * weights[i];
+	return sum;
+#endif
+}
+
+///////////////////////////////
+// reads a weights file, replacing any network loaded before. returns
+// false, with the network unloaded, if the file can't be read or
+// isn't the size this network should be.
+///////////////////////////////
+bool
+load_network(const char *filename)
+{
+	FILE *fp;
+	char magic[8];
+	bool ok;
+
+	unload_network();
+
+	if ((fp = fopen(filename, "rb")) == NULL) {
+		cout << "Could not open network file: " << filename << endl;
+		return false;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	if (ftell(fp) != NNUE_FILE_SIZE) {
+		cout << "Network file " << filename << " is " << ftell(fp)
+			<< " bytes, expected " << NNUE_FILE_SIZE << endl;
+		fclose(fp);
+		return false;
+	}
+	fseek(fp, 0, SEEK_SET);
+
+	if ((featureWeights = (int16 *)malloc(NNUE_INPUTS * NNUE_HIDDEN * sizeof(int16))) == NULL) {
+		cout << "Failed to allocate network memory" << endl;
+		fclose(fp);
+		return false;
+	}
+
+	ok = fread(magic, 1, 8, fp) == 8 && !memcmp(magic, NNUE_MAGIC, 8)
+		&& fread(featureWeights, sizeof(int16), NNUE_INPUTS * NNUE_HIDDEN, fp) == NNUE_INPUTS * NNUE_HIDDEN
+		&& fread(featureBiases, sizeof(int16), NNUE_HIDDEN, fp) == NNUE_HIDDEN
+		&& fread(outputWeights, sizeof(int16), 2 * NNUE_HIDDEN, fp) == 2 * NNUE_HIDDEN
+		&& fread(&outputBias, sizeof(int16), 1, fp) == 1;
+	fclose(fp);
+
+	if (!ok) {
+		cout << "Bad network file: " << filename << endl;
+		unload_network();
+		return false;
+	}
+
+	nnueEnabled = true;
+	return true;
+}
+
+///////////////////////////////
+// goes back to the classical evaluation.
+///////////////////////////////
+void
+unload_network(void)
+{
+	nnueEnabled = false;
+	free(featureWeights);
+	featureWeights = NULL;
+}
+
+///////////////////////////////
+// sums up one side's hidden layer from the pieces on the board.
+///////////////////////////////
+static void
+refresh_side(const position_t *pos, int16 *values, int side)
+{
+	int bucket = KingBucket(side, KingSq(side));
+	int features[32], count = 0;
+	bitboard_t pieces = Occupied & ~Kings(WHITE) & ~Kings(BLACK);
+	int sq;
+
+	memcpy(values, featureBiases, sizeof(featureBiases));
+	while (pieces) {
+		sq = poplsb(pieces);
+		features[count++] = Feature(side, bucket, PieceOn(sq), sq);
+		if (count == 32) {
+			apply_rows(values, values, features, count, NULL, 0);
+			count = 0;
+		}
+	}
+	apply_rows(values, values, features, count, NULL, 0);
+}
+
+///////////////////////////////
+// sums up the accumulator of the given ply from scratch, for a new
+// root position.
+///////////////////////////////
+void
+refresh_accumulator(position_t *pos, int ply)
+{
+	refresh_side(pos, Accumulator(ply).values[WHITE], WHITE);
+	refresh_side(pos, Accumulator(ply).values[BLACK], BLACK);
+}
+
+///////////////////////////////
+// brings the accumulator of ply + 1 up to date with the move just
+// made from ply, from the one of ply. called by make_move, once the
+// board is updated.
+///////////////////////////////
+void
+update_accumulator(position_t *pos, move_t move, int ply)
+{
+	uint8 stm = Stm(ply), opp = stm ^ 1;
+	uint8 from = From(move), to = To(move);
+	uint8 pc = Piece(move), cap = Capture(move), prom = Promote(move);
+	uint8 added[2] = { 0 }, addedSq[2] = { 0 }, removed[2] = { 0 }, removedSq[2] = { 0 };
+	int addCount = 0, removeCount = 0;
+	int adds[2] = { 0 }, subs[2] = { 0 };
+
+	if (PieceType(pc) == KING) {
+		// castling moves the rook too. the king itself isn't an input
+		if (IsCastle(move)) {
+			uint8 rook = MakePiece(ROOK, stm);
+			removed[removeCount] = rook;
+			removedSq[removeCount++] = to > from ? to + 1 : to - 2;
+			added[addCount] = rook;
+			addedSq[addCount++] = to > from ? to - 1 : to + 1;
+		}
+	} else {
+		removed[removeCount] = pc;
+		removedSq[removeCount++] = from;
+		added[addCount] = prom != EMPTY ? prom : pc;
+		addedSq[addCount++] = to;
+	}
+
+	if (IsEnPassant(move)) {
+		removed[removeCount] = MakePiece(PAWN, opp);
+		removedSq[removeCount++] = stm == WHITE ? to - 8 : to + 8;
+	} else if (cap != EMPTY) {
+		removed[removeCount] = cap;
+		removedSq[removeCount++] = to;
+	}
+
+	for (int side = WHITE; side <= BLACK; side++) {
+		int16 *values = Accumulator(ply + 1).values[side];
+		int bucket = KingBucket(side, KingSq(side));
+
+		if (PieceType(pc) == KING && side == stm && bucket != KingBucket(side, from)) {
+			refresh_side(pos, values, side);
+			continue;
+		}
+
+		for (int i = 0; i < addCount; i++)
+			adds[i] = Feature(side, bucket, added[i], addedSq[i]);
+		for (int i = 0; i < removeCount; i++)
+			subs[i] = Feature(side, bucket, removed[i], removedSq[i]);
+		apply_rows(values, Accumulator(ply).values[side], adds, addCount, subs, removeCount);
+	}
+}
+
+///////////////////////////////
+// checks the accumulator of the given ply against one summed up from
+// scratch. for evalbench.
+///////////////////////////////
+bool
+verify_accumulator(position_t *pos, int ply)
+{
+	accumulator_t fresh;
+
+	refresh_side(pos, fresh.values[WHITE], WHITE);
+	refresh_side(pos, fresh.values[BLACK], BLACK);
+	return !memcmp(&fresh, &Accumulator(ply), sizeof(accumulator_t));
+}
+
+///////////////////////////////
+// the network's score for the side to move.
+///////////////////////////////
+int
+nnue_eval(const position_t *pos, int ply)
+{
+	uint8 stm = Stm(ply);
+	int sum = output_sum(Accumulator(ply).values[stm], outputWeights)
+		+ output_sum(Accumulator(ply).values[stm ^ 1], outputWeights + NNUE_HIDDEN);
+
+	return (sum / NNUE_QA + outputBias) * NNUE_SCALE / NNUE_QB;
+}
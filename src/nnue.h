@@ -0,0 +1,40 @@
+#ifndef BENTHOS_NNUE_H
+#define BENTHOS_NNUE_H
+
+// the network is a single hidden layer, seen from both sides:
+//
+//   inputs:  one per (king bucket, piece, square) of each side's own
+//            king, NNUE_INPUTS in all. kings aren't inputs themselves,
+//            the own king only picks the bucket.
+//   hidden:  NNUE_HIDDEN int16 neurons per side, the accumulator,
+//            clipped to [0, NNUE_QA].
+//   output:  the side to move's hidden layer, then the other side's,
+//            dotted with the output weights.
+//
+// the score is (sum / NNUE_QA + bias) * NNUE_SCALE / NNUE_QB, in
+// centipawns for the side to move. the hidden layer is quantized by
+// NNUE_QA and the output weights by NNUE_QB.
+#define NNUE_BUCKETS      8
+#define NNUE_PIECES      10
+#define NNUE_INPUTS      (NNUE_BUCKETS * NNUE_PIECES * 64)
+#define NNUE_QA         255
+#define NNUE_QB          64
+#define NNUE_SCALE      400
+
+// the weights file is the magic, then little endian int16s:
+//   feature weights [NNUE_INPUTS][NNUE_HIDDEN]
+//   feature biases  [NNUE_HIDDEN]
+//   output weights  [2 * NNUE_HIDDEN]
+//   output bias
+#define NNUE_MAGIC      "BENTHNN1"
+#define NNUE_FILE_SIZE  (8 + 2 * (NNUE_INPUTS * NNUE_HIDDEN + NNUE_HIDDEN + 2 * NNUE_HIDDEN + 1))
+
+#if defined(USE_AVX2)
+#define NNUE_KERNEL "avx2"
+#elif defined(USE_SSE2)
+#define NNUE_KERNEL "sse2"
+#else
+#define NNUE_KERNEL "scalar"
+#endif
+
+#endif // !defined(BENTHOS_NNUE_H)
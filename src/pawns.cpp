@@ -0,0 +1,147 @@
+#include "benthos.h"
+#include <cstring>
+#include "eval.h"
+
+///////////////////////////////
+// the pawn hash table. the pawn structure changes far less often than
+// the rest of the position, so everything it decides by itself is
+// evaluated once per pawn configuration, and kept here by the pawn
+// hash key.
+//
+// like the transposition table, it's shared by the search threads
+// without locking. an entry is too large to store in one go, so its
+// check word is the key xored with everything else in it, and an
+// entry that doesn't check out is simply evaluated again.
+///////////////////////////////
+
+phash_entry_t *pawnHash = NULL;
+uint64         pawnHashMask;
+
+static void   eval_pawn_structure(const position_t *, phash_entry_t *);
+static hashkey_t pawn_entry_check(const phash_entry_t *);
+
+///////////////////////////////
+// prepares the pawn hash table, using the largest power of two number
+// of entries that fits in size bytes.
+///////////////////////////////
+void
+init_pawn_hash(int size)
+{
+	uint64 max = 1;
+
+	while (max * 2 * sizeof(phash_entry_t) <= (uint64)size)
+		max *= 2;
+
+	free(pawnHash);
+	if ((pawnHash = (phash_entry_t *)malloc(max * sizeof(phash_entry_t))) == NULL) {
+		cout << "Failed to allocate pawn hash memory: " << (max * sizeof(phash_entry_t)) << " bytes" << endl;
+		pawnHashMask = 0;
+		return;
+	}
+	pawnHashMask = max - 1;
+	clear_pawn_hash();
+}
+
+void
+clear_pawn_hash(void)
+{
+	if (pawnHash != NULL)
+		memset(pawnHash, 0, (pawnHashMask + 1) * sizeof(phash_entry_t));
+}
+
+///////////////////////////////
+// fills in entry with the pawn structure of the position at the given
+// ply, from the table if it's there, and into the table if it wasn't.
+// the entry is a copy, so another thread storing over the table's
+// can't change it while it's in use.
+///////////////////////////////
+void
+probe_pawns(const position_t *pos, int ply, phash_entry_t *entry, phash_stats_t *stats)
+{
+	hashkey_t key = PawnHashKey(ply);
+	phash_entry_t *slot;
+
+	if (pawnHash == NULL) {
+		eval_pawn_structure(pos, entry);
+		return;
+	}
+
+	stats->probes++;
+	slot = &pawnHash[key & pawnHashMask];
+	*entry = *slot;
+	if ((entry->check ^ pawn_entry_check(entry)) == key) {
+		stats->hits++;
+		return;
+	}
+
+	eval_pawn_structure(pos, entry);
+	entry->check = key ^ pawn_entry_check(entry);
+	*slot = *entry;
+}
+
+///////////////////////////////
+// everything in an entry but the check word, folded into one word.
+///////////////////////////////
+static hashkey_t
+pawn_entry_check(const phash_entry_t *entry)
+{
+	return (hashkey_t)(unsigned int)entry->score
+		^ entry->passed[WHITE] ^ entry->passed[BLACK]
+		^ (entry->weak[WHITE] << 1) ^ (entry->weak[BLACK] << 2)
+		^ (entry->attackSpans[WHITE] << 3) ^ (entry->attackSpans[BLACK] << 4);
+}
+
+///////////////////////////////
+// evaluates the pawn structure alone, from white's point of view.
+//
+// doubled:  there's another pawn of the same color ahead of it
+// isolated: there are no pawns of the same color on adjacent files
+// backward: no pawn of the same color on an adjacent file is level
+//           with it or behind it, so none can come to protect it, and
+//           an enemy pawn guards the square in front of it
+// passed:   no enemy pawn ahead of it, on its own or an adjacent file
+///////////////////////////////
+static void
+eval_pawn_structure(const position_t *pos, phash_entry_t *entry)
+{
+	bitboard_t pawns, own, enemy, adjacent;
+	int score[2] = { 0, 0 };
+	int sq, stop;
+
+	memset(entry, 0, sizeof(phash_entry_t));
+
+	for (int c = WHITE; c <= BLACK; c++) {
+		own = Pawns(c);
+		enemy = Pawns(c ^ 1);
+		pawns = own;
+
+		while (pawns) {
+			sq = poplsb(pawns);
+			stop = c == WHITE ? sq + 8 : sq - 8;
+			adjacent = AttackSpan(c, sq) | AttackSpan(c ^ 1, sq)
+				| (KingMoves(sq) & RankMask(Rank(sq)));
+			entry->attackSpans[c] |= AttackSpan(c, sq);
+
+			if (own & FrontSpan(c, sq)) {
+				score[c] -= DOUBLED_PAWN_PENALTY;
+				entry->weak[c] |= Mask(sq);
+			}
+
+			if (!(own & adjacent)) {
+				score[c] -= ISOLATED_PAWN_PENALTY;
+				entry->weak[c] |= Mask(sq);
+			} else if (!(own & adjacent & ~AttackSpan(c, sq))
+					&& (enemy & (c == WHITE ? WhitePawnAttacks(stop) : BlackPawnAttacks(stop)))) {
+				score[c] -= BACKWARD_PAWN_PENALTY;
+				entry->weak[c] |= Mask(sq);
+			}
+
+			if (!(enemy & PassedMask(c, sq))) {
+				score[c] += passedPawnBonus[c == WHITE ? Rank(sq) : 7 - Rank(sq)];
+				entry->passed[c] |= Mask(sq);
+			}
+		}
+	}
+
+	entry->score = score[WHITE] - score[BLACK];
+}
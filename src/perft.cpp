@@ -1,4 +1,8 @@
 #include "benthos.h"
+#include <cstring>
+#include <pthread.h>
+#include <sys/time.h>
+#include <vector>
 
 ///////////////////////////////
 // for my own sanity, perft runs as a completely separate program.
@@ -12,19 +16,91 @@
 //      with (presumably) correct answers
 //
 // the perft code itself is largely crafty's.
+//
+// since the move generators are strictly legal, the last ply needn't
+// be made at all: the "bulk" mode just adds up the number of moves
+// generated there. the default mode still makes and unmakes every leaf
+// move, which keeps make_move/unmake_move in the benchmark.
+//
+// with -threads, the first two plies are split into a list of move
+// pairs, which the worker threads pull from one at a time. each worker
+// has its own copy of the position, state stack included.
+//
+// with -hash, subtree counts are cached by (hash key, depth) in a table
+// of their own, so transposed subtrees are only counted once. besides
+// making deep perfts feasible, this leans hard on the incremental
+// zobrist updates in make_move: a bad key shows up as a wrong count.
+//
+// -divide prints the count below each root move, in coordinate
+// notation, so the output can be lined up against another engine's to
+// find the move that goes wrong. -file runs a perft suite in the usual
+// epd format ("<fen> ;D1 20 ;D2 400 ..."), a line at a time.
 ///////////////////////////////
 
-void perft(position_t *, int);
-void do_perft(position_t *, scored_move_t *, int, int);
+double perft(position_t *, int, bool);
+uint64 do_perft(position_t *, scored_move_t *, int, int, bool, uint64 *);
+uint64 parallel_perft(position_t *, int, bool);
+void  *perft_worker(void *);
+double wall_time(void);
+void   init_perft_hash(int);
+bool   probe_perft_hash(hashkey_t, int, uint64 *);
+void   store_perft_hash(hashkey_t, int, uint64);
 void test_all(position_t *);
 void test(position_t *, char *, int);
+void test_file(position_t *, char *, int);
+int  test_epd_line(position_t *, char *, int);
+void divide(position_t *, char *, int);
+char *find_position(char *);
 void usage(void);
 
-position_t *rootPosition;
-state_t     states[MAXPLY];
 int         iterate = 1;
+bool        makeLeaves = true;
+bool        bulkLeaves = false;
+int         threads = 1;
 uint64      total_moves;
 
+// the deepest ;D<n> entry read from a perft suite
+#define MAXSUITEDEPTH 16
+
+///////////////////////////////
+// an entry in the perft hash table. the depth is packed into the top
+// byte of the data word, and the check word is the hash key xored with
+// the data. an entry torn by two threads storing at once fails the
+// check, so the table can be shared by the perft threads without locks.
+///////////////////////////////
+typedef struct perft_hash_entry {
+	uint64 check;
+	uint64 data;
+} perft_hash_entry_t;
+
+#define PerftHashData(count, depth) ((count) | ((uint64)(depth) << 56))
+#define PerftHashCount(data)        ((data) & ULL(0x00ffffffffffffff))
+#define PerftHashDepth(data)        ((int)((data) >> 56))
+
+perft_hash_entry_t *perftHash = NULL;
+uint64              perftHashMask;
+uint64              perftHashHits;
+
+///////////////////////////////
+// the work shared by the perft threads: every legal pair of moves from
+// the root, and the index of the next pair nobody has taken yet.
+///////////////////////////////
+typedef struct perft_work {
+	position_t    *root;
+	int            depth;
+	bool           bulk;
+	move_t        *pairs;
+	int            pairCount;
+	volatile int   nextPair;
+} perft_work_t;
+
+typedef struct perft_thread {
+	pthread_t      thread;
+	perft_work_t  *work;
+	uint64         count;
+	uint64         hashHits;       // summed into perftHashHits once joined
+} perft_thread_t;
+
 #define KNOWN_POSITIONS 11
 
 // the positions available for the tests
@@ -168,19 +244,46 @@ int
 main(int argc, char *argv[])
 {
 	position_t *pos = (position_t *)malloc(sizeof(position_t));
-	rootPosition = pos;
 
-	init_bitboards();
 	init_mersenne();
+	init_bitboards();
 	init_zobrist();
+	init_eval();
 
 	for (int i = 1; i < argc; i++) {
 		if (!strcmp(argv[i], "-help"))
 			usage();
 		else if (!strcmp(argv[i], "-noit"))
 			iterate = 0;
+		else if (!strcmp(argv[i], "-bulk")) {
+			makeLeaves = false;
+			bulkLeaves = true;
+		} else if (!strcmp(argv[i], "-both"))
+			makeLeaves = bulkLeaves = true;
+		else if (!strcmp(argv[i], "-hash")) {
+			if (argc <= i + 1)
+				usage();
+			init_perft_hash(atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "-threads")) {
+			if (argc <= i + 1)
+				usage();
+			threads = atoi(argv[++i]);
+			if (threads < 1 || threads > MAXTHREADS)
+				usage();
+		}
 		else if (!strcmp(argv[i], "-all"))
 			test_all(pos);
+		else if (!strcmp(argv[i], "-file")) {
+			if (argc <= i + 1)
+				usage();
+			test_file(pos, argv[i+1], argc > i + 2 ? atoi(argv[i+2]) : 0);
+			exit(0);
+		} else if (!strcmp(argv[i], "-divide")) {
+			if (argc <= i + 2)
+				usage();
+			divide(pos, argv[i+1], atoi(argv[i+2]));
+			exit(0);
+		}
 		else if (!strcmp(argv[i], "-test")) {
 			if (argc <= i + 2)
 				usage();
@@ -208,12 +311,181 @@ test_all(position_t *pos)
 	}
 }
 
+///////////////////////////////
+// returns the fen of the known position with the given name, or NULL.
+///////////////////////////////
+char *
+find_position(char *name)
+{
+	for (int i = 0; i < KNOWN_POSITIONS; i++)
+		if (!strcmp(names[i], name))
+			return positions[i];
+	return NULL;
+}
+
+///////////////////////////////
+// runs every position of a perft suite, one per line. lines are
+// checked up to max_depth, or every depth given if it's zero.
+///////////////////////////////
+void
+test_file(position_t *pos, char *filename, int max_depth)
+{
+	FILE *fp = fopen(filename, "r");
+	char buf[1024];
+	int line = 0, passed = 0, tested = 0, result;
+	vector<int> failures;
+	double start_time = wall_time();
+
+	if (fp == NULL) {
+		cout << "Could not open input file: " << filename << endl;
+		exit(1);
+	}
+
+	while (fgets(buf, sizeof(buf), fp) != NULL) {
+		line++;
+		buf[strcspn(buf, "\r\n")] = '\0';
+		if (buf[0] == '\0' || buf[0] == '#')
+			continue;
+
+		printf("line %4d: ", line);
+		result = test_epd_line(pos, buf, max_depth);
+		if (result < 0)
+			continue;
+
+		tested++;
+		if (result)
+			passed++;
+		else
+			failures.push_back(line);
+	}
+	fclose(fp);
+
+	printf("\n%d of %d positions passed [%.2f secs]\n", passed, tested,
+			wall_time() - start_time);
+	if (!failures.empty()) {
+		printf("failed lines:");
+		for (unsigned i = 0; i < failures.size(); i++)
+			printf(" %d", failures[i]);
+		printf("\n");
+	}
+}
+
+///////////////////////////////
+// checks the counts of a single perft suite line, stopping at the
+// first depth that's wrong. the whole line is reported on one line
+// of output, so a large suite stays readable. returns 1 if every
+// count checked was correct, 0 if not, and -1 if there was nothing
+// to check below max_depth.
+///////////////////////////////
+int
+test_epd_line(position_t *pos, char *line, int max_depth)
+{
+	uint64 expected[MAXSUITEDEPTH + 1];
+	char fen[256];
+	char *p = strchr(line, ';');
+	int depth, deepest = 0;
+	uint64 count;
+	double time_used = 0;
+	int len;
+
+	if (p == NULL) {
+		printf("no counts given, skipping: %s\n", line);
+		return -1;
+	}
+
+	len = p - line;
+	while (len > 0 && isspace(line[len - 1]))
+		len--;
+	if (len >= (int)sizeof(fen))
+		len = sizeof(fen) - 1;
+	strncpy(fen, line, len);
+	fen[len] = '\0';
+
+	// collect the ;D<depth> <count> fields
+	memset(expected, 0, sizeof(expected));
+	for (; p != NULL; p = strchr(p + 1, ';')) {
+		if (sscanf(p, ";D%d %llu", &depth, &count) != 2)
+			continue;
+		if (depth < 1 || depth > MAXSUITEDEPTH)
+			continue;
+		if (max_depth && depth > max_depth)
+			continue;
+		expected[depth] = count;
+		if (depth > deepest)
+			deepest = depth;
+	}
+
+	if (!position_from_fen(pos, fen)) {
+		printf("bad fen: %s\n", fen);
+		return 0;
+	}
+
+	if (deepest == 0) {
+		printf("nothing to check, skipping: %s\n", fen);
+		return -1;
+	}
+
+	for (depth = iterate ? 1 : deepest; depth <= deepest; depth++) {
+		if (!expected[depth])
+			continue;
+		time_used += perft(pos, depth, bulkLeaves);
+		if (total_moves != expected[depth]) {
+			printf("depth %d FAILED: %llu, expected %llu [%6.2f secs] %s\n",
+					depth, total_moves, expected[depth], time_used, fen);
+			return 0;
+		}
+	}
+
+	printf("depth %d ok [%6.2f secs] %s\n", deepest, time_used, fen);
+	return 1;
+}
+
+///////////////////////////////
+// prints the count below each legal root move, then the total.
+// the position may be either a known name or a fen.
+///////////////////////////////
+void
+divide(position_t *pos, char *name, int depth)
+{
+	scored_move_t moveStack[4096];
+	scored_move_t *end, *mv;
+	char *fen = find_position(name);
+	uint64 count, total = 0;
+	double start_time;
+
+	if (fen == NULL)
+		fen = name;
+	if (!position_from_fen(pos, fen)) {
+		cout << "Bad fen: " << fen << endl;
+		exit(1);
+	}
+	if (depth < 1)
+		usage();
+
+	cout << "divide to depth " << depth << ": " << fen << endl;
+
+	start_time = wall_time();
+	pos->states[1] = pos->states[0];
+	end = generate_moves(pos, moveStack, 1);
+	for (mv = moveStack; mv < end; mv++) {
+		make_move(pos, mv->move, 1);
+		count = depth > 1 ? do_perft(pos, end, 2, depth - 1, bulkLeaves, &perftHashHits) : 1;
+		unmake_move(pos, mv->move, 1);
+
+		printf("%s: %llu\n", move2str(mv->move), count);
+		total += count;
+	}
+
+	printf("\nmoves: %d\nnodes: %llu [%.2f secs]\n",
+			(int)(end - moveStack), total, wall_time() - start_time);
+}
+
 void
 test(position_t *pos, char *name, int max_depth)
 {
 	char *fen = NULL;
 	uint64 *expected = NULL;
-	clock_t start_time, end_time;
+	uint64 made = 0;
 	double time_used;
 	int depth = iterate ? 1 : max_depth;
 	int i;
@@ -234,14 +506,33 @@ test(position_t *pos, char *name, int max_depth)
 	cout << "'" << name << "' test: " << fen << endl;
 
 	for (; depth <= max_depth; depth++) {
-		start_time = clock();
-		perft(pos, depth);
-		end_time = clock();
-		time_used = ((double)end_time - (double)start_time) / 1000;
+		printf("depth %d: ", depth);
+		if (makeLeaves) {
+			time_used = perft(pos, depth, false);
+			made = total_moves;
+			printf("%12llu [%6.2f secs - %10.0f nps]", total_moves,
+					time_used, time_used > 0 ? total_moves / time_used : 0);
+		}
+
+		// with both modes, the bulk counts go side by side with the made ones.
+		// the hash table is cleared first, or the bulk count would just be
+		// read back out of it.
+		if (bulkLeaves) {
+			if (makeLeaves && perftHash)
+				memset(perftHash, 0, (perftHashMask + 1) * sizeof(perft_hash_entry_t));
+			time_used = perft(pos, depth, true);
+			if (!makeLeaves)
+				printf("%12llu", total_moves);
+			printf(" [bulk %6.2f secs - %10.0f nps]",
+					time_used, time_used > 0 ? total_moves / time_used : 0);
+			if (makeLeaves && made != total_moves)
+				printf(" [mismatch: bulk counted %llu]", total_moves);
+		}
+
+		if (perftHash)
+			printf(" [%llu hash hits]", perftHashHits);
 
 		// if we have something to match again, see if we were right
-		printf("depth %d: %12llu [%6.2f secs - %8.0f nps]", depth, total_moves,
-				time_used, (total_moves / time_used));
 		if (depth <= depths[i][1]) {
 			if (expected[depth - 1] == total_moves)
 				printf(" [correct]\n");
@@ -252,58 +543,221 @@ test(position_t *pos, char *name, int max_depth)
 	}
 }
 
-void
-perft(position_t *pos, int depth)
+///////////////////////////////
+// runs a perft to the given depth, leaving the count in total_moves.
+// returns the (wall clock) time used in seconds.
+///////////////////////////////
+double
+perft(position_t *pos, int depth, bool bulk)
 {
 	scored_move_t moveStack[4096];
+	double start_time;
 	memset(moveStack, 0, sizeof(scored_move_t)*4096);
 
-	total_moves = 0;
-	states[1] = states[0];
-	do_perft(pos, moveStack, 1, depth);
+	perftHashHits = 0;
+	start_time = wall_time();
+	if (threads > 1 && depth > 2)
+		total_moves = parallel_perft(pos, depth, bulk);
+	else {
+		pos->states[1] = pos->states[0];
+		total_moves = do_perft(pos, moveStack, 1, depth, bulk, &perftHashHits);
+	}
+
+	return wall_time() - start_time;
 }
 
-void
-do_perft(position_t *pos, scored_move_t *ms, int ply, int depth)
+uint64
+do_perft(position_t *pos, scored_move_t *ms, int ply, int depth, bool bulk, uint64 *hashHits)
 {
 	scored_move_t *msbase = ms;
-	uint8 stm = Stm(ply);
 	scored_move_t *mv;
+	uint64 count = 0;
 
-	if (Checked(stm^1))
-		return;
-
-	if (Checked(stm)) {
-		ms = generate_evasions(pos, ms, ply);
-		for (mv = msbase; mv < ms; mv++)
-			if (PieceType(Capture(mv->move)) == KING)
-				return;
-	} else {
-		ms = generate_captures(pos, ms, ply);
-		for (mv = msbase; mv < ms; mv++)
-			if (PieceType(Capture(mv->move)) == KING)
-				return;
-		ms = generate_noncaptures(pos, ms, ply);
+	if (perftHash && depth > 1 && probe_perft_hash(HashKey(ply), depth, &count)) {
+		(*hashHits)++;
+		return count;
 	}
 
+	// the generators are fully legal, so every move counts
+	ms = generate_moves(pos, ms, ply);
+
+	if (bulk && depth == 1)
+		return ms - msbase;
+
 	for (mv = msbase; mv < ms; mv++) {
 		make_move(pos, mv->move, ply);
 		if (depth - 1)
-			do_perft(pos, ms, ply + 1, depth - 1);
-		else if (!Checked(stm))
-			total_moves++;
+			count += do_perft(pos, ms, ply + 1, depth - 1, bulk, hashHits);
+		else
+			count++;
 		unmake_move(pos, mv->move, ply);
 	}
+
+	if (perftHash && depth > 1)
+		store_perft_hash(HashKey(ply), depth, count);
+
+	return count;
+}
+
+///////////////////////////////
+// splits a perft of at least depth 3 over the worker threads, and
+// returns the sum of their counts.
+///////////////////////////////
+uint64
+parallel_perft(position_t *pos, int depth, bool bulk)
+{
+	scored_move_t moveStack[512];
+	scored_move_t *rootEnd, *replyEnd, *mv, *reply;
+	perft_thread_t workers[MAXTHREADS];
+	perft_work_t work;
+	uint64 count = 0;
+	int i;
+
+	work.root      = pos;
+	work.depth     = depth;
+	work.bulk      = bulk;
+	work.pairCount = 0;
+	work.nextPair  = 0;
+
+	// 2 * 218 * 218 is a comfortable bound on the number of pairs
+	work.pairs = (move_t *)malloc(2 * 218 * 218 * sizeof(move_t));
+
+	rootEnd = generate_moves(pos, moveStack, 0);
+	for (mv = moveStack; mv < rootEnd; mv++) {
+		make_move(pos, mv->move, 0);
+		replyEnd = generate_moves(pos, rootEnd, 1);
+		for (reply = rootEnd; reply < replyEnd; reply++) {
+			work.pairs[2 * work.pairCount]     = mv->move;
+			work.pairs[2 * work.pairCount + 1] = reply->move;
+			work.pairCount++;
+		}
+		unmake_move(pos, mv->move, 0);
+	}
+
+	for (i = 0; i < threads; i++) {
+		workers[i].work  = &work;
+		workers[i].count = 0;
+		workers[i].hashHits = 0;
+		pthread_create(&workers[i].thread, NULL, perft_worker, &workers[i]);
+	}
+	for (i = 0; i < threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		count += workers[i].count;
+		perftHashHits += workers[i].hashHits;
+	}
+
+	free(work.pairs);
+	return count;
+}
+
+///////////////////////////////
+// the body of a perft thread. takes move pairs off the shared list
+// until it runs dry, and perfts the remaining depth below each one.
+///////////////////////////////
+void *
+perft_worker(void *arg)
+{
+	perft_thread_t *self = (perft_thread_t *)arg;
+	perft_work_t *work = self->work;
+	scored_move_t moveStack[4096];
+	position_t pos = *work->root;
+	move_t first, second;
+	int idx;
+
+	while ((idx = __sync_fetch_and_add(&work->nextPair, 1)) < work->pairCount) {
+		first  = work->pairs[2 * idx];
+		second = work->pairs[2 * idx + 1];
+
+		make_move(&pos, first, 0);
+		make_move(&pos, second, 1);
+		self->count += do_perft(&pos, moveStack, 2, work->depth - 2, work->bulk, &self->hashHits);
+		unmake_move(&pos, second, 1);
+		unmake_move(&pos, first, 0);
+	}
+
+	return NULL;
+}
+
+///////////////////////////////
+// allocates the perft hash table, using the largest power of two
+// number of entries that fits in the given number of megabytes.
+///////////////////////////////
+void
+init_perft_hash(int mb)
+{
+	uint64 bytes = (uint64)mb << 20;
+	uint64 entries = 1;
+
+	while (entries * 2 * sizeof(perft_hash_entry_t) <= bytes)
+		entries *= 2;
+
+	perftHash = (perft_hash_entry_t *)calloc(entries, sizeof(perft_hash_entry_t));
+	if (perftHash == NULL) {
+		cout << "Failed to allocate perft hash memory: " << mb << "mb" << endl;
+		exit(1);
+	}
+	perftHashMask = entries - 1;
+}
+
+///////////////////////////////
+// looks up the count of the subtree with the given key and depth.
+// returns true and fills in count if it was found.
+///////////////////////////////
+bool
+probe_perft_hash(hashkey_t key, int depth, uint64 *count)
+{
+	perft_hash_entry_t *entry = &perftHash[key & perftHashMask];
+	uint64 data  = entry->data;
+	uint64 check = entry->check;
+
+	if ((check ^ data) != key || PerftHashDepth(data) != depth)
+		return false;
+
+	*count = PerftHashCount(data);
+	return true;
+}
+
+///////////////////////////////
+// stores the count of a subtree, always replacing.
+///////////////////////////////
+void
+store_perft_hash(hashkey_t key, int depth, uint64 count)
+{
+	perft_hash_entry_t *entry = &perftHash[key & perftHashMask];
+	uint64 data = PerftHashData(count, depth);
+
+	entry->data  = data;
+	entry->check = key ^ data;
+}
+
+///////////////////////////////
+// returns the wall clock time in seconds. clock() won't do here, as it
+// adds up the cpu time of every thread.
+///////////////////////////////
+double
+wall_time(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
 }
 
 void
 usage(void)
 {
-	printf("usage: perft [-help|-noit] [-test <name> <depth>|-all]\n");
+	printf("usage: perft [-help|-noit|-bulk|-both] [-threads <n>] [-hash <mb>]\n");
+	printf("             [-test <name> <depth>|-all|-divide <name|fen> <depth>|-file <file.epd> [<depth>]]\n");
 	printf("       -help: prints this.\n");
 	printf("       -noit: disables \"iterative\" testing, which starts over for each depth.\n");
+	printf("       -bulk: counts the legal moves at the last ply instead of making them.\n");
+	printf("       -both: runs both the normal and bulk counts, reporting them side by side.\n");
+	printf("       -threads: splits the first two plies over <n> threads. (default: 1)\n");
+	printf("       -hash: caches subtree counts in a table of <mb> megabytes. (default: off)\n");
 	printf("       -test: runs a perft on position <name> to depth <depth>.\n");
-	printf("       -all : runs a perft on all available positions to default depth.\n\n");
+	printf("       -all : runs a perft on all available positions to default depth.\n");
+	printf("       -divide: prints the perft to <depth> below each root move of a position.\n");
+	printf("       -file: runs a perft suite of \"<fen> ;D1 <count> ;D2 <count> ...\" lines,\n");
+	printf("              up to <depth> if given. with -noit, only the deepest count is run.\n\n");
 
 	printf("available positions:\n");
 	printf("  format: <name> (<default depth>): <fen>\n");
@@ -0,0 +1,266 @@
+#include "benthos.h"
+#include "search.h"
+
+static bool find_hash_move(move_picker_t *, const position_t *);
+static inline scored_move_t *pick_best(scored_move_t *, scored_move_t *);
+
+///////////////////////////////
+// the staged move picker hands out the moves of a node one at a time,
+// and only generates a stage's moves once the stages before it have
+// run dry. a cutoff on the hash move or an early capture then saves
+// generating (and scoring) everything else.
+//
+// the stages, out of check:
+//   the hash move
+//   good captures, by mvv/lva
+//   the killer moves, if they're legal here, before the quiet moves
+//   are generated
+//   the other quiet moves, by history score
+//   bad captures, the ones losing material by see(), by mvv/lva
+//
+// in check, the hash move and then the other evasions. the quiescence
+// search gets just the captures, by mvv/lva, or the evasions.
+//
+// every generated list is laid out on the move stack handed to
+// init_picker(), and picker->top is the first slot past them, for
+// the nodes below to use.
+///////////////////////////////
+
+///////////////////////////////
+// readies a picker for the node at the given ply. the hash move is
+// the packed one from the hash table, or 0. the killers and history
+// scores for the quiet moves are taken from the search info.
+///////////////////////////////
+void
+init_picker(move_picker_t *picker, const position_t *pos, scored_move_t *ms, int ply,
+		move_t hashMove, const search_info_t *info)
+{
+	picker->ply = ply;
+	picker->hashMove = hashMove;
+	picker->killers[0] = info ? info->killers[ply][0] : 0;
+	picker->killers[1] = info ? info->killers[ply][1] : 0;
+	picker->nextKiller = 0;
+	picker->historyScores = info ? info->historyScores[Stm(ply)] : NULL;
+	picker->top = ms;
+	picker->cur = picker->end = ms;
+	picker->captures = picker->capturesEnd = NULL;
+	picker->quiets = picker->quietsEnd = NULL;
+	picker->badCaptures = picker->badEnd = NULL;
+	picker->stage = Checked(Stm(ply)) ? PICK_GEN_EVASIONS : PICK_GEN_CAPTURES;
+	if (hashMove)
+		picker->stage--;
+}
+
+///////////////////////////////
+// readies a picker for a quiescence node at the given ply.
+///////////////////////////////
+void
+init_quiesce_picker(move_picker_t *picker, const position_t *pos, scored_move_t *ms, int ply)
+{
+	init_picker(picker, pos, ms, ply, 0, NULL);
+	if (picker->stage == PICK_GEN_CAPTURES)
+		picker->stage = PICK_GEN_QCAPTURES;
+}
+
+///////////////////////////////
+// the hash move can't be played blind, as a key collision could hand
+// us anything at all. it's looked up in the legal moves of the stage
+// it belongs to, which are generated for the purpose and kept for
+// that stage. returns true with picker->hashMove set to the full move
+// if it was found.
+///////////////////////////////
+static bool
+find_hash_move(move_picker_t *picker, const position_t *pos)
+{
+	int ply = picker->ply;
+	move_t hashMove = picker->hashMove;
+	uint8 from = From(hashMove), to = To(hashMove);
+	scored_move_t *mv, *begin = picker->top, *end;
+
+	picker->hashMove = 0;
+	if (PieceOn(from) == EMPTY || PieceColor(PieceOn(from)) != Stm(ply))
+		return false;
+
+	if (picker->stage == PICK_HASH_EVASION) {
+		end = generate_evasions(pos, begin, ply);
+		picker->cur = begin;
+		picker->end = end;
+	} else if (PieceOn(to) != EMPTY
+			|| (PieceType(PieceOn(from)) == PAWN && to == EpSquare(ply))) {
+		end = generate_captures(pos, begin, ply);
+		picker->captures = begin;
+		picker->capturesEnd = end;
+	} else {
+		end = generate_noncaptures(pos, begin, ply);
+		picker->quiets = begin;
+		picker->quietsEnd = end;
+	}
+	picker->top = end;
+
+	for (mv = begin; mv < end; mv++)
+		if (HashMove(mv->move) == hashMove) {
+			picker->hashMove = mv->move;
+			return true;
+		}
+
+	return false;
+}
+
+///////////////////////////////
+// returns the next move to search, or 0 once there are none left.
+///////////////////////////////
+move_t
+next_move(move_picker_t *picker, const position_t *pos)
+{
+	scored_move_t *mv;
+	move_t move;
+
+	while (true) {
+		switch (picker->stage) {
+		case PICK_HASH_EVASION:
+		case PICK_HASH:
+			picker->stage++;
+			if (find_hash_move(picker, pos))
+				return picker->hashMove;
+			break;
+
+		case PICK_GEN_CAPTURES:
+			if (picker->captures == NULL) {
+				picker->captures = picker->top;
+				picker->capturesEnd = generate_captures(pos, picker->top, picker->ply);
+				picker->top = picker->capturesEnd;
+			}
+			for (mv = picker->captures; mv < picker->capturesEnd; mv++)
+				mv->score = MvvLva(mv->move);
+			picker->cur = picker->captures;
+			picker->end = picker->capturesEnd;
+			picker->badCaptures = picker->badEnd = picker->captures;
+			picker->stage++;
+			break;
+
+		// a losing capture is moved down over the captures already
+		// handed out, to be tried after the quiet moves.
+		case PICK_GOOD_CAPTURES:
+			while (picker->cur < picker->end) {
+				mv = pick_best(picker->cur++, picker->end);
+				if (mv->move == picker->hashMove)
+					continue;
+				if (losing_capture(pos, mv->move)) {
+					*picker->badEnd++ = *mv;
+					continue;
+				}
+				return mv->move;
+			}
+			picker->stage++;
+			break;
+
+		// a killer comes from another node at this ply, so it's only
+		// played once it's known to be legal here. a cutoff on one
+		// saves generating the quiet moves at all.
+		case PICK_KILLERS:
+			while (picker->nextKiller < 2) {
+				move = picker->killers[picker->nextKiller++];
+				if (move && move != picker->hashMove
+						&& is_legal_noncapture(pos, move, picker->ply))
+					return move;
+			}
+			picker->stage++;
+			break;
+
+		case PICK_GEN_QUIETS:
+			if (picker->quiets == NULL) {
+				picker->quiets = picker->top;
+				picker->quietsEnd = generate_noncaptures(pos, picker->top, picker->ply);
+				picker->top = picker->quietsEnd;
+			}
+			for (mv = picker->quiets; mv < picker->quietsEnd; mv++)
+				mv->score = picker->historyScores[From(mv->move)][To(mv->move)];
+			picker->cur = picker->quiets;
+			picker->end = picker->quietsEnd;
+			picker->stage++;
+			break;
+
+		// the killers were played already, if they were in the list
+		case PICK_QUIETS:
+			while (picker->cur < picker->end) {
+				move = pick_best(picker->cur++, picker->end)->move;
+				if (move != picker->hashMove && move != picker->killers[0]
+						&& move != picker->killers[1])
+					return move;
+			}
+			picker->cur = picker->badCaptures;
+			picker->end = picker->badEnd;
+			picker->stage++;
+			break;
+
+		// already in mvv/lva order
+		case PICK_BAD_CAPTURES:
+			if (picker->cur < picker->end)
+				return (picker->cur++)->move;
+			picker->stage = PICK_DONE;
+			break;
+
+		case PICK_GEN_EVASIONS:
+			if (picker->cur == picker->end) {
+				picker->cur = picker->top;
+				picker->end = generate_evasions(pos, picker->top, picker->ply);
+				picker->top = picker->end;
+			}
+			for (mv = picker->cur; mv < picker->end; mv++)
+				mv->score = MvvLva(mv->move);
+			picker->stage++;
+			break;
+
+		case PICK_EVASIONS:
+			while (picker->cur < picker->end) {
+				move = pick_best(picker->cur++, picker->end)->move;
+				if (move != picker->hashMove)
+					return move;
+			}
+			picker->stage = PICK_DONE;
+			break;
+
+		case PICK_GEN_QCAPTURES:
+			picker->cur = picker->top;
+			picker->end = generate_captures(pos, picker->top, picker->ply);
+			picker->top = picker->end;
+			for (mv = picker->cur; mv < picker->end; mv++)
+				mv->score = MvvLva(mv->move);
+			picker->stage++;
+			break;
+
+		case PICK_QCAPTURES:
+			if (picker->cur < picker->end)
+				return pick_best(picker->cur++, picker->end)->move;
+			picker->stage = PICK_DONE;
+			break;
+
+		default:
+			return 0;
+		}
+	}
+}
+
+///////////////////////////////
+// swaps the best scored move left in [mv, end) into mv, and returns
+// mv. a selection sort done one move at a time, as a cutoff usually
+// comes long before the list would be sorted.
+///////////////////////////////
+static inline scored_move_t *
+pick_best(scored_move_t *mv, scored_move_t *end)
+{
+	scored_move_t *best = mv, *i;
+	scored_move_t tmp;
+
+	for (i = mv + 1; i < end; i++)
+		if (i->score > best->score)
+			best = i;
+
+	if (best != mv) {
+		tmp = *mv;
+		*mv = *best;
+		*best = tmp;
+	}
+
+	return mv;
+}
@@ -16,7 +16,7 @@ clear_position(position_t *pos)
 		KingSq(c) = INVALID_SQUARE;
 	}
 
-	Occupied = Occupied90L = Occupied45L = Occupied45R = 0;
+	Occupied = 0;
 }
 
 ///////////////////////////////
@@ -24,13 +24,15 @@ clear_position(position_t *pos)
 // the default empty values
 ///////////////////////////////
 void
-reset_state(int ply)
+reset_state(position_t *pos, int ply)
 {
 	Stm(ply) = WHITE;
 	Castling(ply) = 0;
 	HalfmoveClock(ply) = 0;
 	HashKey(ply) = 0;
 	PawnHashKey(ply) = 0;
+	PsqScore(ply, MIDGAME) = 0;
+	PsqScore(ply, ENDGAME) = 0;
 
 	for (int c = WHITE; c <= BLACK; c++) {
 		Material(ply, c) = 0;
@@ -53,10 +55,10 @@ position_from_fen(position_t *pos, char *fen)
 {
 	char *p = fen;
 	int sq;
-	int hmc;
+	int hmc = 0;
 
 	clear_position(pos);
-	reset_state(0);
+	reset_state(pos, 0);
 
 	sq = 56;
 	do {
@@ -113,19 +115,19 @@ position_from_fen(position_t *pos, char *fen)
 	}
 
 	while (isspace(*p)) p++;
-	if (*p == '-')
+	if (*p == '-') {
 		EpSquare(0) = INVALID_SQUARE;
-	else {
+		p++;
+	} else {
 		uint8 f = *p++ - 'a';
 		uint8 r = *p++ - '1';
 		EpSquare(0) = (r << 3) | f;
 	}
 
-	if (*p != '\0') {
-		while (isspace(*p)) p++;
-		sscanf(p, "%d", &hmc);
+	// epd lines stop short of the clocks
+	while (isspace(*p)) p++;
+	if (*p != '\0' && sscanf(p, "%d", &hmc) == 1)
 		HalfmoveClock(0) = hmc;
-	}
 
 	for (sq = 0; sq < 64; sq++) {
 		uint8 pc    = PieceOn(sq);
@@ -135,6 +137,8 @@ position_from_fen(position_t *pos, char *fen)
 			continue;
 
 		Material(0, color) += PieceValue(pc);
+		PsqScore(0, MIDGAME) += Psq(MIDGAME, pc, sq);
+		PsqScore(0, ENDGAME) += Psq(ENDGAME, pc, sq);
 
 		Pieces(color) |= Mask(sq);
 		switch (type) {
@@ -167,10 +171,7 @@ position_from_fen(position_t *pos, char *fen)
 		}
 	}
 
-	Occupied    = Pieces(WHITE) | Pieces(BLACK);
-	Occupied90L = rotate90L(Occupied);
-	Occupied45L = rotate45L(Occupied);
-	Occupied45R = rotate45R(Occupied);
+	Occupied = Pieces(WHITE) | Pieces(BLACK);
 
 	// need at least both kings, and they can't be in passive check
 	if (KingSq(WHITE) == INVALID_SQUARE || KingSq(BLACK) == INVALID_SQUARE)
@@ -179,6 +180,8 @@ position_from_fen(position_t *pos, char *fen)
 		return false;
 
 	calculate_hash_keys(pos, 0);
+	if (nnueEnabled)
+		refresh_accumulator(pos, 0);
 
 	return true;
 }
@@ -1,4 +1,7 @@
 #include "benthos.h"
+#include <cstring>
+#include <pthread.h>
+#include <math.h>
 #include "search.h"
 
 //#define DEBUG
@@ -8,25 +11,80 @@
 //
 // TODO: besides "everything", time controls should be implemented
 // ASAP, to make iterative deepening+hash table worth doing.
+//
+// everything a search works on lives in its search_context_t: the
+// position (state stack included), the game history and the search
+// info. nothing but the hash table is shared, so any number of
+// contexts can search at once.
+//
+// with more than one thread, the search is a "lazy smp" one: the
+// helper threads run the same iterative deepening on contexts of their
+// own, copied from the main one, and only share the hash table. what
+// they find there steers the main thread's search. half of the helpers
+// search one ply deeper than the rest, so that the threads don't all
+// walk the same tree in lockstep.
 ///////////////////////////////
 
-static void search_root(position_t *, scored_move_t *, int, int, int);
-static int  alphabeta(position_t *, scored_move_t *, int, int, int, int);
-static int  compare_moves(const void *, const void *);
-static bool is_search_draw(int);
-static void new_search(void);
-static inline bool should_stop(void);
+static void aspiration_search(search_context_t *, scored_move_t *, int);
+static void search_root(search_context_t *, scored_move_t *, int, int, int);
+static int  alphabeta(search_context_t *, scored_move_t *, int, int, int, int, bool);
+static int  quiesce(search_context_t *, scored_move_t *, int, int, int);
+static bool is_search_draw(search_context_t *, int);
+static void new_search(search_context_t *);
+static void update_quiet_heuristics(search_info_t *, move_t, int, int, uint8);
+static void age_history(search_info_t *, int);
+static void init_reductions(void);
+static inline bool should_stop(search_context_t *);
+static void start_helpers(search_context_t *);
+static void stop_helpers(search_context_t *);
+static void *helper_search(void *);
+static move_t best_thread_move(search_context_t *);
 
-search_info_t *searchInfo = NULL;
+///////////////////////////////
+// a lazy smp helper thread, with the context it searches.
+///////////////////////////////
+typedef struct helper_thread {
+	pthread_t        thread;
+	int              id;
+	search_context_t ctx;
+} helper_thread_t;
 
 ///////////////////////////////
-// just allocates memory for the search info structure
+// late move reductions, by remaining depth and by how many moves of
+// the node were searched before. filled in by init_reductions().
 ///////////////////////////////
-void
-init_search(void)
+static int  reductions[64][64];
+static bool reductionsReady = false;
+
+///////////////////////////////
+// allocates a context for a new game, searching on one thread.
+///////////////////////////////
+search_context_t *
+new_search_context(void)
 {
-	searchInfo = (search_info_t *)malloc(sizeof(search_info_t));
-	memset(searchInfo, 0, sizeof(search_info_t));
+	search_context_t *ctx = (search_context_t *)malloc(sizeof(search_context_t));
+	memset(ctx, 0, sizeof(search_context_t));
+	ctx->threads = 1;
+
+	if (!reductionsReady)
+		init_reductions();
+
+	return ctx;
+}
+
+///////////////////////////////
+// the reduction grows with the log of the depth left and the log of
+// the move's place in the ordering: the deeper the node and the later
+// the move, the less likely it is to be any good.
+///////////////////////////////
+static void
+init_reductions(void)
+{
+	for (int depth = 1; depth < 64; depth++)
+		for (int index = 1; index < 64; index++)
+			reductions[depth][index] = (int)(0.5 + log((double)depth) * log((double)index) / 2.0);
+
+	reductionsReady = true;
 }
 
 ///////////////////////////////
@@ -38,206 +96,526 @@ init_search(void)
 // started.
 ///////////////////////////////
 move_t
-search(position_t *pos)
+search(search_context_t *ctx)
 {
 	int depth = 0;
 	scored_move_t moveStack[2048];
-	scored_move_t *rms = searchInfo->rootMoves;
+	position_t *pos = &ctx->pos;
+	search_info_t *info = &ctx->info;
+	scored_move_t *rms = info->rootMoves;
 
-	new_search();
+	new_search(ctx);
 
 	// generate root move list
-	if (!Checked(Stm(0))) {
-		rms = generate_captures(pos, rms, 0);
-		rms = generate_noncaptures(pos, rms, 0);
-	} else
-		rms = generate_evasions(pos, rms, 0);
-	searchInfo->rootMoveCount = rms - searchInfo->rootMoves;
+	rms = generate_moves(pos, rms, 0);
+	info->rootMoveCount = rms - info->rootMoves;
+
+	start_helpers(ctx);
 
 	// iterative deepening
-	while (!should_stop()) {
-		searchInfo->depth = ++depth;
-		search_root(pos, moveStack, -INFINITY, INFINITY, depth);
-		report_search_info();
-		if (searchInfo->matesFound >= 2)
+	while (!should_stop(ctx)) {
+		info->depth = ++depth;
+		aspiration_search(ctx, moveStack, depth);
+		if (info->status != ABORTED) {
+			info->completedDepth = depth;
+			info->completedMove = info->bestRootMove;
+		}
+		report_search_info(ctx);
+		if (info->matesFound >= 2)
+			break;
+	}
+
+	stop_helpers(ctx);
+
+	return best_thread_move(ctx);
+}
+
+///////////////////////////////
+// starts threads - 1 helpers, each on a copy of the position and the
+// search info of the context.
+///////////////////////////////
+static void
+start_helpers(search_context_t *ctx)
+{
+	helper_thread_t *helper;
+
+	ctx->stopHelpers = false;
+	ctx->helperCount = Min(ctx->threads, MAXTHREADS) - 1;
+	if (ctx->helperCount > 0 && ctx->helpers == NULL)
+		ctx->helpers = (helper_thread_t *)malloc((MAXTHREADS - 1) * sizeof(helper_thread_t));
+
+	for (int i = 0; i < ctx->helperCount; i++) {
+		helper = &ctx->helpers[i];
+		helper->id = i + 1;
+		helper->ctx.pos = ctx->pos;
+		helper->ctx.info = ctx->info;
+		helper->ctx.info.helper = true;
+		helper->ctx.threads = 1;
+		helper->ctx.helpers = NULL;
+		helper->ctx.helperCount = 0;
+		helper->ctx.parent = ctx;
+		pthread_create(&helper->thread, NULL, helper_search, helper);
+	}
+}
+
+///////////////////////////////
+// tells the helpers to stop, and waits for them to do so.
+///////////////////////////////
+static void
+stop_helpers(search_context_t *ctx)
+{
+	ctx->stopHelpers = true;
+	for (int i = 0; i < ctx->helperCount; i++)
+		pthread_join(ctx->helpers[i].thread, NULL);
+}
+
+///////////////////////////////
+// the body of a helper thread. the same iterative deepening as the
+// main thread's, but odd numbered helpers start a ply deeper.
+///////////////////////////////
+static void *
+helper_search(void *arg)
+{
+	helper_thread_t *self = (helper_thread_t *)arg;
+	search_context_t *ctx = &self->ctx;
+	search_info_t *info = &ctx->info;
+	scored_move_t moveStack[2048];
+	int depth = self->id & 1;
+
+	while (!should_stop(ctx)) {
+		info->depth = ++depth;
+		aspiration_search(ctx, moveStack, depth);
+		if (info->status != ABORTED) {
+			info->completedDepth = depth;
+			info->completedMove = info->bestRootMove;
+		}
+		if (info->matesFound >= 2)
 			break;
-		qsort(searchInfo->rootMoves, searchInfo->rootMoveCount, sizeof(scored_move_t), compare_moves);
 	}
 
-	return searchInfo->bestRootMove;
+	return NULL;
+}
+
+///////////////////////////////
+// picks the move to play. the main thread's best move stands, unless
+// a helper finished an iteration deeper than the main thread did. if
+// the search was stopped before it found anything, say by a clock
+// that had already run out, the first legal move is played instead.
+///////////////////////////////
+static move_t
+best_thread_move(search_context_t *ctx)
+{
+	move_t best = ctx->info.bestRootMove;
+	int bestDepth = ctx->info.completedDepth;
+	search_info_t *info;
+
+	for (int i = 0; i < ctx->helperCount; i++) {
+		info = &ctx->helpers[i].ctx.info;
+		if (info->completedDepth > bestDepth && info->completedMove) {
+			best = info->completedMove;
+			bestDepth = info->completedDepth;
+		}
+	}
+
+	if (!best && ctx->info.rootMoveCount > 0)
+		best = ctx->info.rootMoves[0].move;
+
+	return best;
+}
+
+///////////////////////////////
+// returns the number of nodes searched by all of the threads.
+///////////////////////////////
+uint64
+search_nodes(const search_context_t *ctx)
+{
+	uint64 nodes = ctx->info.nodes;
+
+	for (int i = 0; i < ctx->helperCount; i++)
+		nodes += ctx->helpers[i].ctx.info.nodes;
+
+	return nodes;
+}
+
+///////////////////////////////
+// adds up the table and evaluation usage of all of the threads. the
+// helpers have to be stopped first, as each counts in its own info.
+///////////////////////////////
+void
+search_stats(const search_context_t *ctx, hash_stats_t *hash, phash_stats_t *pawns, eval_stats_t *evals)
+{
+	const search_info_t *info;
+
+	memset(hash, 0, sizeof(hash_stats_t));
+	memset(pawns, 0, sizeof(phash_stats_t));
+	memset(evals, 0, sizeof(eval_stats_t));
+
+	for (int i = -1; i < ctx->helperCount; i++) {
+		info = i < 0 ? &ctx->info : &ctx->helpers[i].ctx.info;
+		hash->probes        += info->hashStats.probes;
+		hash->hits          += info->hashStats.hits;
+		hash->stores        += info->hashStats.stores;
+		hash->replaced      += info->hashStats.replaced;
+		hash->staleReplaced += info->hashStats.staleReplaced;
+		pawns->probes       += info->pawnHashStats.probes;
+		pawns->hits         += info->pawnHashStats.hits;
+		evals->calls        += info->evalStats.calls;
+		evals->lazyExits    += info->evalStats.lazyExits;
+		evals->cacheHits    += info->evalStats.cacheHits;
+	}
+}
+
+///////////////////////////////
+// searches one iteration, in a window around the score of the last
+// one. if the score falls outside of the window, the side it fell out
+// of is widened and the iteration searched again, until the window
+// grows past ASPIRATION_MAX and that side is opened up entirely.
+///////////////////////////////
+static void
+aspiration_search(search_context_t *ctx, scored_move_t *ms, int depth)
+{
+	search_info_t *info = &ctx->info;
+	int prev = info->bestRootScore;
+	int alphaDelta = ASPIRATION_WINDOW, betaDelta = ASPIRATION_WINDOW;
+	int alpha = -INFINITY, beta = INFINITY;
+
+	if (depth >= ASPIRATION_DEPTH && abs(prev) < MATE - 200) {
+		alpha = prev - alphaDelta;
+		beta  = prev + betaDelta;
+	}
+
+	while (true) {
+		search_root(ctx, ms, alpha, beta, depth);
+		if (info->status == ABORTED)
+			return;
+
+		if (info->bestRootScore <= alpha && alpha > -INFINITY) {
+			info->failLows++;
+			alphaDelta *= 4;
+			alpha = alphaDelta > ASPIRATION_MAX ? -INFINITY : prev - alphaDelta;
+		} else if (info->bestRootScore >= beta && beta < INFINITY) {
+			info->failHighs++;
+			betaDelta *= 4;
+			beta = betaDelta > ASPIRATION_MAX ? INFINITY : prev + betaDelta;
+		} else
+			return;
+	}
 }
 
 ///////////////////////////////
 // the alpha-beta method used for the root node. separated since it
 // can't use things like the hash table, it has to keep track of the
 // best root move so far, etc.
+//
+// the first move is searched with the full window, and every other
+// one with a null window, only to prove it's no better. the few that
+// turn out better are searched again with the full window. the best
+// move is moved to the front of the list afterward, to be searched
+// first in the next iteration, and the rest keep their order.
 ///////////////////////////////
 static void
-search_root(position_t *pos, scored_move_t *ms, int alpha, int beta, int depth)
+search_root(search_context_t *ctx, scored_move_t *ms, int alpha, int beta, int depth)
 {
-	uint8 stm = Stm(0);
+	position_t *pos = &ctx->pos;
+	search_info_t *info = &ctx->info;
+	scored_move_t best;
+	int bestIndex = 0;
+	move_t move;
 	int val;
-	searchInfo->bestRootScore = alpha;
-
-	for (int i = 0; i < searchInfo->rootMoveCount; i++) {
-		// skip moves previously marked as illegal
-		if (!searchInfo->rootMoves[i].move)
-			continue;
+	info->bestRootScore = alpha;
 
-		if (should_stop())
+	for (int i = 0; i < info->rootMoveCount; i++) {
+		if (should_stop(ctx))
 			break;
 
-		searchInfo->curRootMoveNum = i;
-
-		// clear illegal moves so we don't bother with them again
-		make_move(pos, searchInfo->rootMoves[i].move, 0);
-		if (depth == 1 && Checked(stm)) {
-			unmake_move(pos, searchInfo->rootMoves[i].move, 0);
-			searchInfo->rootMoves[i].move = 0;
-			searchInfo->rootMoves[i].score = -INFINITY;
-			continue;
-		}
+		info->curRootMoveNum = i;
+		move = info->rootMoves[i].move;
+		make_move(pos, move, 0);
 
 		// store the key in the array for checking threefold repetition
-		searchInfo->keyLog[searchInfo->keyidx] = HashKey(1);
+		info->keyLog[info->keyidx] = HashKey(1);
 
 		// go into normal alpha beta for search ply 1
-		val = -alphabeta(pos, ms, -beta, -alpha, 1, depth - 1);
-		unmake_move(pos, searchInfo->rootMoves[i].move, 0);
-
-		searchInfo->rootMoves[i].score = val;
-		if (val > searchInfo->bestRootScore) {
-			searchInfo->bestRootScore = val;
-			searchInfo->bestRootMove = searchInfo->rootMoves[i].move;
+		if (i == 0)
+			val = -alphabeta(ctx, ms, -beta, -alpha, 1, depth - 1, true);
+		else {
+			val = -alphabeta(ctx, ms, -alpha - 1, -alpha, 1, depth - 1, true);
+			if (val > alpha && val < beta) {
+				info->pvsResearches++;
+				val = -alphabeta(ctx, ms, -beta, -alpha, 1, depth - 1, true);
+			}
 		}
+		unmake_move(pos, move, 0);
+
+		// an aborted search returns nothing to go on
+		if (info->status == ABORTED)
+			break;
+
 		if (val > MATE)
-			searchInfo->matesFound++;
+			info->matesFound++;
+		if (val > alpha) {
+			alpha = val;
+			info->bestRootScore = val;
+			info->bestRootMove = move;
+			bestIndex = i;
+			if (val >= beta)
+				break;
+		}
+	}
+
+	if (bestIndex > 0) {
+		best = info->rootMoves[bestIndex];
+		memmove(&info->rootMoves[1], &info->rootMoves[0], bestIndex * sizeof(scored_move_t));
+		info->rootMoves[0] = best;
 	}
 }
 
 ///////////////////////////////
 // the alpha-beta method used for all nodes beyond the root.
 //
-// sply  = the current _search_ ply (root = 0, moves from root -> 1, etc)
-// depth = the depth remaining for the search
+// sply   = the current _search_ ply (root = 0, moves from root -> 1, etc)
+// depth  = the depth remaining for the search
+// nullOk = whether a null move may be tried; never twice in a row
+//
+// null move pruning: if the side to move could pass and a reduced
+// search still fails high, a real move almost certainly would too.
+// passing is only a fair test when some move is no worse than doing
+// nothing, which breaks down in zugzwang. so it's never tried in check,
+// and only when the side to move has a piece besides its king and
+// pawns, as zugzwang is mostly a pawn endgame affair. it's also left
+// out of the principal variation, where the window is open.
+//
+// late move reductions: once the first LMR_MOVES moves have been
+// searched, the later quiet moves are searched to a depth reduced by
+// the reductions table. the ordering already thinks little of them.
+// one that fails high anyway is searched again to the full depth.
+// captures, promotions and moves in or into check are never reduced.
 ///////////////////////////////
 static int
-alphabeta(position_t *pos, scored_move_t *ms, int alpha, int beta, int sply, int depth)
+alphabeta(search_context_t *ctx, scored_move_t *ms, int alpha, int beta, int sply, int depth, bool nullOk)
 {
-	scored_move_t *msbase = ms;
-	scored_move_t *mv;
+	position_t *pos = &ctx->pos;
+	search_info_t *info = &ctx->info;
+	move_picker_t picker;
 	uint8 stm = Stm(sply);
-	move_t bestMove = 0, hashMove = 0;
+	move_t move, bestMove = 0, hashMove = 0;
 	hashkey_t hashKey = HashKey(sply);
 	int hashScoreType = ALPHA;
-	int val, legals = 0;
-
-	searchInfo->nodes++;
+	int moveCount = 0;
+	int val, r;
+	bool inCheck;
 
 	if (depth == 0)
-		return eval(pos, sply);
+		return quiesce(ctx, ms, alpha, beta, sply);
 
-	if (is_search_draw(sply))
+	info->nodes++;
+
+	if (is_search_draw(ctx, sply))
 		return 0;
 
-	if (should_stop())
+	if (should_stop(ctx))
 		return alpha;
 
-	val = probe_hash(hashKey, depth, alpha, beta, &hashMove);
+	val = probe_hash(hashKey, depth, alpha, beta, &hashMove, &info->hashStats);
 	if (val != HASH_VAL_UNKNOWN)
 		return val;
 
-	if (hashMove) {
-		make_move(pos, hashMove, sply);
-		if (!Checked(stm)) {
-			legals++;
-			searchInfo->keyLog[searchInfo->keyidx + sply] = HashKey(sply + 1);
-			val = -alphabeta(pos, ms, -beta, -alpha, sply + 1, depth - 1);
-			unmake_move(pos, hashMove, sply);
-			if (val >= beta) {
-				store_hash(hashKey, depth, BETA, beta, hashMove);
-				return beta;
+	inCheck = Checked(stm);
+	if (nullOk && depth >= 2 && beta - alpha == 1 && !inCheck
+			&& MinorCount(sply, stm) + MajorCount(sply, stm) > 0
+			&& eval(pos, sply, beta - 1, beta, info) >= beta) {
+		make_null_move(pos, sply);
+		info->keyLog[info->keyidx + sply] = HashKey(sply + 1);
+		val = -alphabeta(ctx, ms, -beta, -beta + 1, sply + 1, Max(depth - 1 - NullReduction(depth), 0), false);
+		unmake_null_move(pos, sply);
+		if (val >= beta) {
+			info->nullCutoffs++;
+			return beta;
+		}
+	}
+
+	init_picker(&picker, pos, ms, sply, hashMove, info);
+	while ((move = next_move(&picker, pos)) != 0) {
+		moveCount++;
+		make_move(pos, move, sply);
+		info->keyLog[info->keyidx + sply] = HashKey(sply + 1);
+
+		// principal variation search: only the first move gets the full
+		// window, as above
+		if (moveCount == 1)
+			val = -alphabeta(ctx, picker.top, -beta, -alpha, sply + 1, depth - 1, true);
+		else {
+			r = 0;
+			if (depth >= LMR_DEPTH && moveCount > LMR_MOVES && !inCheck
+					&& !Capture(move) && !Promote(move) && !Checked(Stm(sply + 1))) {
+				r = reductions[Min(depth, 63)][Min(moveCount, 63)];
+				r = Min(r, depth - 2);
 			}
-			if (val > alpha) {
-				bestMove = hashMove;
-				hashScoreType = EXACT;
-				alpha = val;
+
+			val = -alphabeta(ctx, picker.top, -alpha - 1, -alpha, sply + 1, depth - 1 - r, true);
+			if (r > 0) {
+				info->lmrReductions++;
+				if (val > alpha) {
+					info->lmrResearches++;
+					val = -alphabeta(ctx, picker.top, -alpha - 1, -alpha, sply + 1, depth - 1, true);
+				}
 			}
-		} else
-			unmake_move(pos, hashMove, sply);
+			if (val > alpha && val < beta) {
+				info->pvsResearches++;
+				val = -alphabeta(ctx, picker.top, -beta, -alpha, sply + 1, depth - 1, true);
+			}
+		}
+		unmake_move(pos, move, sply);
+		if (val >= beta) {
+			info->cutoffs++;
+			if (moveCount == 1)
+				info->firstMoveCutoffs++;
+			if (!Capture(move) && !Promote(move))
+				update_quiet_heuristics(info, move, sply, depth, stm);
+			store_hash(hashKey, depth, BETA, beta, move, &info->hashStats);
+			return beta;
+		}
+		if (val > alpha) {
+			bestMove = move;
+			hashScoreType = EXACT;
+			alpha = val;
+		}
 	}
 
-	if (!Checked(stm)) {
-		ms = generate_captures(pos, ms, sply);
-		ms = generate_noncaptures(pos, ms, sply);
-	} else
-		ms = generate_evasions(pos, ms, sply);
+	// the moves are fully legal, so no moves means mate or stalemate
+	if (moveCount == 0)
+		return Checked(stm) ? -MATE-sply : 0;
 
-	for (mv = msbase; mv < ms; mv++) {
-		if (mv->move == hashMove)
-			continue;
+	store_hash(hashKey, depth, hashScoreType, alpha, bestMove, &info->hashStats);
+	return alpha;
+}
 
-		make_move(pos, mv->move, sply);
-		if (!Checked(stm)) {
-			legals++;
-			searchInfo->keyLog[searchInfo->keyidx + sply] = HashKey(sply + 1);
-			val = -alphabeta(pos, ms, -beta, -alpha, sply + 1, depth - 1);
-			unmake_move(pos, mv->move, sply);
-			if (val >= beta) {
-				store_hash(hashKey, depth, beta, BETA, mv->move);
-				return beta;
-			}
-			if (val > alpha) {
-				bestMove = mv->move;
-				hashScoreType = EXACT;
-				alpha = val;
-			}
-		} else
-			unmake_move(pos, mv->move, sply);
+///////////////////////////////
+// the quiescence search, run at the leaves of the main search so that
+// positions are only evaluated once they're quiet. only captures are
+// searched, unless the side to move is in check, in which case every
+// evasion is.
+//
+// out of check, the side to move may "stand pat" on the static eval
+// rather than capture. captures that can't raise the eval to within
+// DELTA_MARGIN of alpha, even winning the piece for free, are skipped,
+// as are captures that lose material by static exchange evaluation.
+///////////////////////////////
+static int
+quiesce(search_context_t *ctx, scored_move_t *ms, int alpha, int beta, int sply)
+{
+	position_t *pos = &ctx->pos;
+	search_info_t *info = &ctx->info;
+	move_picker_t picker;
+	move_t move;
+	bool inCheck = Checked(Stm(sply));
+	int standPat = 0, moveCount = 0, val;
+
+	info->nodes++;
+	if (sply > info->seldepth)
+		info->seldepth = sply;
+
+	if (should_stop(ctx))
+		return alpha;
+
+	if (sply >= MAXPLY - 1)
+		return eval(pos, sply, alpha, beta, info);
+
+	if (!inCheck) {
+		standPat = eval(pos, sply, alpha, beta, info);
+		if (standPat >= beta)
+			return beta;
+		if (standPat > alpha)
+			alpha = standPat;
 	}
 
-	if (!legals) {
-		if (Checked(stm))
-			return -MATE-sply;
-		else
-			return 0;
+	init_quiesce_picker(&picker, pos, ms, sply);
+	while ((move = next_move(&picker, pos)) != 0) {
+		moveCount++;
+
+		if (!inCheck && !Promote(move)
+				&& standPat + PieceValue(PieceType(Capture(move))) + DELTA_MARGIN <= alpha)
+			continue;
+		if (!inCheck && losing_capture(pos, move))
+			continue;
+
+		make_move(pos, move, sply);
+		val = -quiesce(ctx, picker.top, -beta, -alpha, sply + 1);
+		unmake_move(pos, move, sply);
+		if (val >= beta)
+			return beta;
+		if (val > alpha)
+			alpha = val;
 	}
 
-	store_hash(hashKey, depth, hashScoreType, alpha, bestMove);
+	if (inCheck && moveCount == 0)
+		return -MATE-sply;
+
 	return alpha;
 }
 
 ///////////////////////////////
-// compares two scored_move_t values for qsort()
+// a quiet move caused a beta cutoff: it becomes the first killer of
+// its ply, and its history score grows with the depth searched. when
+// a score reaches HISTORY_MAX, the whole table is halved, so that the
+// scores stay in proportion.
 ///////////////////////////////
-static int
-compare_moves(const void *a, const void *b)
+static void
+update_quiet_heuristics(search_info_t *info, move_t move, int sply, int depth, uint8 stm)
 {
-	scored_move_t *m1 = (scored_move_t *)a;
-	scored_move_t *m2 = (scored_move_t *)b;
-	if (m1->score > m2->score)
-		return -1;
-	if (m1->score == m2->score)
-		return 0;
-	return 1;
+	move_t *killers = info->killers[sply];
+	int *score = &info->historyScores[stm][From(move)][To(move)];
+
+	if (killers[0] != move) {
+		killers[1] = killers[0];
+		killers[0] = move;
+	}
+
+	*score += depth * depth;
+	if (*score >= HISTORY_MAX)
+		age_history(info, 1);
+}
+
+///////////////////////////////
+// forgets the move ordering learned from the searches so far, for a
+// new game. between the searches of one game, they're only aged.
+///////////////////////////////
+void
+clear_history_scores(search_context_t *ctx)
+{
+	memset(ctx->info.historyScores, 0, sizeof(ctx->info.historyScores));
+	memset(ctx->info.killers, 0, sizeof(ctx->info.killers));
+}
+
+///////////////////////////////
+// divides every history score by 2^shift.
+///////////////////////////////
+static void
+age_history(search_info_t *info, int shift)
+{
+	int *score = &info->historyScores[0][0][0];
+
+	for (int i = 0; i < 2 * 64 * 64; i++)
+		score[i] >>= shift;
 }
 
 ///////////////////////////////
 // checks for threefold repetition or 50 move rule draws
 ///////////////////////////////
 static bool
-is_search_draw(int sply)
+is_search_draw(search_context_t *ctx, int sply)
 {
+	position_t *pos = &ctx->pos;
 	hashkey_t key = HashKey(sply);
 	int hmc = HalfmoveClock(sply);
-	int idx = searchInfo->keyidx;
+	int idx = ctx->info.keyidx;
 	int reps = 1;
 
 	if (hmc >= 100)
 		return true;
 
 	while (--hmc >= 0) {
-		if (key == searchInfo->keyLog[--idx])
+		if (key == ctx->info.keyLog[--idx])
 			reps++;
 		if (reps == 3)
 			return true;
@@ -251,31 +629,42 @@ is_search_draw(int sply)
 // max depth/node count, or if we've been asked to stop.
 ///////////////////////////////
 static inline bool
-should_stop(void)
+should_stop(search_context_t *ctx)
 {
-	if (searchInfo->status == ABORTED)
+	search_info_t *info = &ctx->info;
+
+	if (info->status == ABORTED)
 		return true;
 
-	if (!searchInfo->inf && clock() >= searchInfo->endTime) {
-		searchInfo->status = ABORTED;
+	// the helpers leave the clock and the input to the main thread
+	if (info->helper) {
+		if (ctx->parent->stopHelpers || (info->depthLimit != 0 && info->depth > info->depthLimit)) {
+			info->status = ABORTED;
+			return true;
+		}
+		return false;
+	}
+
+	if (!info->inf && get_time() >= info->endTime) {
+		info->status = ABORTED;
 		return true;
 	}
 
-	if (searchInfo->depthLimit != 0 && searchInfo->depth > searchInfo->depthLimit) {
-		searchInfo->status = ABORTED;
+	if (info->depthLimit != 0 && info->depth > info->depthLimit) {
+		info->status = ABORTED;
 		return true;
 	}
 
-	if (searchInfo->nodeLimit != 0 && searchInfo->nodes >= searchInfo->nodeLimit) {
-		searchInfo->status = ABORTED;
+	if (info->nodeLimit != 0 && info->nodes >= info->nodeLimit) {
+		info->status = ABORTED;
 		return true;
 	}
 
 	// check for input every 50k nodes. this half works for now.
-	if (searchInfo->nodes % 50000 == 0) {
+	if (info->nodes % 50000 == 0) {
 		if (input_available()) {
-			parse_input_while_searching();
-			if (searchInfo->status == ABORTED)
+			parse_input_while_searching(ctx);
+			if (info->status == ABORTED)
 				return true;
 		}
 	}
@@ -287,23 +676,53 @@ should_stop(void)
 // resets the search_info_t data for a new search.
 ///////////////////////////////
 static void
-new_search(void)
+new_search(search_context_t *ctx)
 {
-	int ply = currentGamePly - HalfmoveClock(0);
-
-	searchInfo->status = THINKING;
-	searchInfo->depth = 0;
-	searchInfo->nodes = 0;
-	searchInfo->curRootMoveNum = 0;
-	searchInfo->bestRootMove = 0;
-	searchInfo->bestRootScore = -INFINITY;
-	searchInfo->matesFound = 0;
-	searchInfo->startTime = clock();
+	position_t *pos = &ctx->pos;
+	search_info_t *info = &ctx->info;
+	int ply = ctx->gamePly - HalfmoveClock(0);
+
+	info->status = THINKING;
+	info->depth = 0;
+	info->seldepth = 0;
+	info->nodes = 0;
+	info->curRootMoveNum = 0;
+	info->bestRootMove = 0;
+	info->bestRootScore = -INFINITY;
+	info->matesFound = 0;
+	info->completedDepth = 0;
+	info->completedMove = 0;
+	info->helper = false;
+	info->cutoffs = 0;
+	info->firstMoveCutoffs = 0;
+	info->failHighs = 0;
+	info->failLows = 0;
+	info->pvsResearches = 0;
+	info->nullCutoffs = 0;
+	info->lmrReductions = 0;
+	info->lmrResearches = 0;
+	memset(&info->hashStats, 0, sizeof(hash_stats_t));
+	memset(&info->pawnHashStats, 0, sizeof(phash_stats_t));
+	memset(&info->evalStats, 0, sizeof(eval_stats_t));
+	info->startTime = get_time();
+
+	// the network may have been loaded since the position was set up
+	if (nnueEnabled)
+		refresh_accumulator(pos, 0);
+
+	// the killers are stale once the root has moved on, but history
+	// scores carry over to the next search, worth less each time.
+	memset(info->killers, 0, sizeof(info->killers));
+	age_history(info, 2);
+
+	new_hash_search();
 
 	// we now refill the list of hash keys from the history_t array,
 	// but we don't bother filling in any before the last half move
 	// clock reset.
-	searchInfo->keyidx = 0;
-	while (ply <= currentGamePly)
-		searchInfo->keyLog[searchInfo->keyidx++] = history[ply++].hashKey;
+	info->keyidx = 0;
+	if (ply < 0)
+		ply = 0;
+	while (ply <= ctx->gamePly)
+		info->keyLog[info->keyidx++] = ctx->history[ply++].hashKey;
 }
@@ -1,7 +1,40 @@
 #ifndef BENTHOS_SEARCH_H
 #define BENTHOS_SEARCH_H
 
+// math.h has an INFINITY of its own, a float
+#undef  INFINITY
 #define INFINITY 100000
 #define MATE     30000
 
+// margin for delta pruning in the quiescence search: a capture that
+// can't bring the score to within this much of alpha isn't searched.
+#define DELTA_MARGIN 200
+
+// most valuable victim, least valuable attacker. the victim is weighted
+// so heavily that it always decides, and a promotion counts as winning
+// the piece promoted to.
+#define MvvLva(mv) (32 * (PieceValue(PieceType(Capture(mv))) + PieceValue(PieceType(Promote(mv)))) \
+                    - PieceValue(PieceType(Piece(mv))))
+
+// quiet moves are ordered by their history scores, which are kept
+// under HISTORY_MAX.
+#define HISTORY_MAX  (1 << 20)
+
+// aspiration windows: from ASPIRATION_DEPTH on, an iteration is first
+// searched ASPIRATION_WINDOW either side of the last one's score. each
+// fail widens the side it failed on fourfold, and past ASPIRATION_MAX
+// that side is opened up entirely.
+#define ASPIRATION_DEPTH   4
+#define ASPIRATION_WINDOW 50
+#define ASPIRATION_MAX   800
+
+// the depth a null move search is reduced by, besides the ply for the
+// null move itself: more when there's plenty of depth left.
+#define NullReduction(depth) ((depth) > 6 ? 3 : 2)
+
+// late move reductions start with the move after the first LMR_MOVES,
+// and only with at least LMR_DEPTH plies left.
+#define LMR_DEPTH 3
+#define LMR_MOVES 3
+
 #endif // !defined(BENTHOS_SEARCH_H)
@@ -0,0 +1,131 @@
+#include "benthos.h"
+#include <cstring>
+
+///////////////////////////////
+// checks see() against a suite of positions, run as a separate program
+// like perft. each line of the suite is a fen, followed by the move to
+// evaluate and the value expected of it:
+//
+//   <fen> ;move <move> ;see <value>
+//
+// the move is given as in the uci protocol, e.g. e7d8q, and has to be
+// legal in the position.
+///////////////////////////////
+
+int  test_see_line(position_t *, char *);
+void usage(void);
+
+int
+main(int argc, char *argv[])
+{
+	position_t *pos = (position_t *)malloc(sizeof(position_t));
+	char *filename = NULL;
+	char buf[1024];
+	int line = 0, passed = 0, tested = 0, result;
+	FILE *fp;
+
+	init_mersenne();
+	init_bitboards();
+	init_zobrist();
+	init_eval();
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-help"))
+			usage();
+		else if (!strcmp(argv[i], "-file")) {
+			if (argc <= i + 1)
+				usage();
+			filename = argv[++i];
+		} else
+			usage();
+	}
+
+	if (filename == NULL)
+		usage();
+
+	fp = fopen(filename, "r");
+	if (fp == NULL) {
+		printf("Could not open input file: %s\n", filename);
+		exit(1);
+	}
+
+	while (fgets(buf, sizeof(buf), fp) != NULL) {
+		line++;
+		buf[strcspn(buf, "\r\n")] = '\0';
+		if (buf[0] == '\0' || buf[0] == '#')
+			continue;
+
+		printf("line %4d: ", line);
+		result = test_see_line(pos, buf);
+		if (result < 0)
+			continue;
+
+		tested++;
+		if (result)
+			passed++;
+	}
+	fclose(fp);
+
+	printf("\n%d of %d positions passed\n", passed, tested);
+
+	return passed != tested;
+}
+
+///////////////////////////////
+// checks a single line of the suite. returns 1 if see() gave the
+// expected value, 0 if not, and -1 if the line couldn't be used.
+///////////////////////////////
+int
+test_see_line(position_t *pos, char *line)
+{
+	scored_move_t moves[256], *end, *mv;
+	char fen[256], movestr[8];
+	char *p = strchr(line, ';');
+	move_t move = 0;
+	int expected, value, len;
+
+	if (p == NULL || sscanf(p, ";move %7s ;see %d", movestr, &expected) != 2) {
+		printf("no move and value given, skipping: %s\n", line);
+		return -1;
+	}
+
+	len = p - line;
+	while (len > 0 && isspace(line[len - 1]))
+		len--;
+	if (len >= (int)sizeof(fen))
+		len = sizeof(fen) - 1;
+	strncpy(fen, line, len);
+	fen[len] = '\0';
+
+	if (!position_from_fen(pos, fen)) {
+		printf("bad fen: %s\n", fen);
+		return -1;
+	}
+
+	end = generate_moves(pos, moves, 0);
+	for (mv = moves; mv < end; mv++)
+		if (!strcmp(move2str(mv->move), movestr))
+			move = mv->move;
+	if (!move) {
+		printf("illegal move %s, skipping: %s\n", movestr, fen);
+		return -1;
+	}
+
+	value = see(pos, move);
+	if (value != expected) {
+		printf("%-6s FAILED: %d, expected %d %s\n", movestr, value, expected, fen);
+		return 0;
+	}
+
+	printf("%-6s ok %5d %s\n", movestr, value, fen);
+	return 1;
+}
+
+void
+usage(void)
+{
+	printf("usage: seetest [-help] -file <file.epd>\n");
+	printf("       -help: prints this.\n");
+	printf("       -file: specifies the file to read the suite from.\n");
+	exit(1);
+}
@@ -1,4 +1,6 @@
 #include "benthos.h"
+#include <cstring>
+#include "nnue.h"
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -14,6 +16,7 @@ static bool cmd_uci(const char *);
 static bool cmd_isready(const char *);
 static bool cmd_ucinewgame(const char *);
 static bool cmd_position(const char *);
+static bool cmd_setoption(const char *);
 static bool cmd_go(const char *);
 static bool cmd_stop(const char *);
 static bool cmd_quit(const char *);
@@ -22,6 +25,12 @@ static bool cmd_material(const char *);
 static bool cmd_fen(const char *);
 static bool cmd_print(const char *);
 
+static bool opt_hash(int);
+static bool opt_threads(int);
+static bool opt_pawn_hash(int);
+static bool opt_eval_file(const char *);
+static bool opt_eval_cache(int);
+
 static bool get_int_arg(const char *, const char *, int&);
 static bool get_long_arg(const char *, const char *, long&);
 
@@ -35,6 +44,7 @@ parser_t uci_parsers[] = {
 	{ "isready",    cmd_isready },
 	{ "ucinewgame", cmd_ucinewgame },
 	{ "position",   cmd_position },
+	{ "setoption",  cmd_setoption },
 	{ "go",         cmd_go },
 	{ "stop",       cmd_stop },
 	{ "quit",       cmd_quit },
@@ -46,16 +56,40 @@ parser_t uci_parsers[] = {
 	{ 0,            NULL },
 };
 
+typedef struct option {
+	char   *name;
+	char   *desc;                 // the rest of the 'option' line sent to the UI
+	bool  (*pfunc)(int);          // for spins
+	bool  (*sfunc)(const char *); // for strings
+} option_t;
+
+option_t uci_options[] = {
+	{ "Hash",       "type spin default 32 min 1 max 1024", opt_hash },
+	{ "Threads",    "type spin default 1 min 1 max 64",    opt_threads },
+	{ "Pawn Hash",  "type spin default 2 min 1 max 64",    opt_pawn_hash },
+	{ "Eval Cache", "type spin default 4 min 1 max 256",   opt_eval_cache },
+	{ "EvalFile",   "type string default <empty>",         NULL, opt_eval_file },
+
+	{ 0,            NULL,                                  NULL },
+};
+
 // used by epdtest to silence the search status report 
 bool suppressSearchStatus = false;
 
+// the game being played through the UI, and whether the last position
+// command left it in a sane state
+static search_context_t *context = NULL;
+static bool validPosition = true;
+
 ///////////////////////////////
 // the primary focal point of the program. reads input from the UI
 // and passes it on to the command parser.
 ///////////////////////////////
 void
-ui_loop(void)
+ui_loop(search_context_t *ctx)
 {
+	context = ctx;
+
 	char buf[2048];
 	while (true) {
 		cin.getline(buf, 2047);
@@ -93,12 +127,12 @@ input_available(void)
 // TODO: ponderhit
 ///////////////////////////////
 void
-parse_input_while_searching(void)
+parse_input_while_searching(search_context_t *ctx)
 {
 	static char buf[2048];
 	cin.getline(buf, 2047);
 	if (!strncmp(buf, "stop", 4))
-		searchInfo->status = ABORTED;
+		ctx->info.status = ABORTED;
 	else if (!strncmp(buf, "quit", 4))
 		exit(0);
 }
@@ -108,25 +142,63 @@ parse_input_while_searching(void)
 // search status.
 ///////////////////////////////
 void
-report_search_info(void)
+report_search_info(search_context_t *ctx)
 {
-	clock_t time = clock() - searchInfo->startTime;
-	float nps = (float)searchInfo->nodes / (time / 1000);
-	int rmn = searchInfo->curRootMoveNum;
-	int score = searchInfo->bestRootScore;
+	search_info_t *info = &ctx->info;
+	uint64 time = get_time() - info->startTime;
+	uint64 nodes = search_nodes(ctx);
+	float nps = time ? (float)nodes * 1000 / time : 0;
+	int rmn = info->curRootMoveNum;
+	int score = info->bestRootScore;
 
 	if (suppressSearchStatus || time < 1000)
 		return;
 
 	printf("info currmove %s currmovenumber %d\n",
-			move2str(searchInfo->rootMoves[rmn].move), rmn + 1);
-	printf("info depth %d ", searchInfo->depth);
+			move2str(info->rootMoves[rmn].move), rmn + 1);
+	printf("info depth %d seldepth %d ", info->depth, info->seldepth);
 	if (abs(score) < MATE - 200)
 		printf("score cp %d ", score);
 	else
 		printf("score mate %d ", score > 0 ? (score - MATE + 1) / 2 : (score + MATE) / 2);
-	printf("time %lu nodes %llu nps %.0f pv %s\n",
-			time, searchInfo->nodes, nps, move2str(searchInfo->bestRootMove));
+	printf("time %llu nodes %llu nps %.0f hashfull %d pv %s\n",
+			time, nodes, nps, hash_full(), move2str(info->bestRootMove));
+	fflush(stdout);
+}
+
+///////////////////////////////
+// sends the hash table and move ordering statistics of the last
+// search to the UI, as 'info string's.
+///////////////////////////////
+void
+report_search_stats(search_context_t *ctx)
+{
+	search_info_t *info = &ctx->info;
+	hash_stats_t hashStats;
+	phash_stats_t pawnHashStats;
+	eval_stats_t evalStats;
+
+	if (suppressSearchStatus)
+		return;
+
+	search_stats(ctx, &hashStats, &pawnHashStats, &evalStats);
+	printf("info string hash probes %llu hits %llu (%.1f%%) stores %llu replaced %llu stale %llu\n",
+			hashStats.probes, hashStats.hits,
+			hashStats.probes ? 100.0 * hashStats.hits / hashStats.probes : 0.0,
+			hashStats.stores, hashStats.replaced, hashStats.staleReplaced);
+	printf("info string pawn hash probes %llu hits %llu (%.1f%%)\n",
+			pawnHashStats.probes, pawnHashStats.hits,
+			pawnHashStats.probes ? 100.0 * pawnHashStats.hits / pawnHashStats.probes : 0.0);
+	printf("info string evals %llu lazy %llu (%.1f%%) cache hits %llu (%.1f%%)\n",
+			evalStats.calls, evalStats.lazyExits,
+			evalStats.calls ? 100.0 * evalStats.lazyExits / evalStats.calls : 0.0,
+			evalStats.cacheHits,
+			evalStats.calls ? 100.0 * evalStats.cacheHits / evalStats.calls : 0.0);
+	printf("info string first move cutoffs %.1f%% aspiration fail highs %d fail lows %d pvs re-searches %llu null move cutoffs %llu\n",
+			info->cutoffs ? 100.0 * info->firstMoveCutoffs / info->cutoffs : 0.0,
+			info->failHighs, info->failLows, info->pvsResearches, info->nullCutoffs);
+	printf("info string late move reductions %llu re-searches %llu\n",
+			info->lmrReductions, info->lmrResearches);
 	fflush(stdout);
 }
 
@@ -164,8 +236,10 @@ parse_command(char *cmdline)
 static bool
 cmd_uci(const char *args)
 {
-	cout << "id name " << ENGINE_NAME << " " << ENGINE_VERSION << endl;
+	cout << "id name " << ENGINE_NAME << " " << ENGINE_VERSION << " (" << SLIDER_BACKEND << ")" << endl;
 	cout << "id author " << ENGINE_AUTHOR << endl;
+	for (option_t *o = uci_options; o->name; o++)
+		cout << "option name " << o->name << " " << o->desc << endl;
 	cout << "uciok" << endl;
 	cout.flush();
 	return true;
@@ -184,13 +258,16 @@ cmd_isready(const char *args)
 
 ///////////////////////////////
 // resets the board to the initial position suitable for starting
-// a new game. this is actually useless, but just for the sake of it...
+// a new game, and forgets the history scores of the last one. a
+// position command alone keeps them, as it comes before every search.
 ///////////////////////////////
 static bool
 cmd_ucinewgame(const char *args)
 {
-	position_from_fen(rootPosition, STARTING_FEN);
-	history_new_game();
+	position_from_fen(&context->pos, STARTING_FEN);
+	history_new_game(context);
+	clear_history_scores(context);
+	validPosition = true;
 	return true;
 }
 
@@ -204,8 +281,8 @@ static bool
 cmd_position(const char *args)
 {
 	move_t mv;
-	char *fen = strstr(args, "fen");
-	char *moves = strstr(args, "moves");
+	char *fen = (char *)strstr(args, "fen");
+	const char *moves = strstr(args, "moves");
 	char move_text[10];
 	char *p;
 
@@ -214,19 +291,20 @@ cmd_position(const char *args)
 			int len = strlen(fen) - strlen(moves) - 1;
 			*(fen+len) = '\0';
 		}
-		if (!position_from_fen(rootPosition, fen+4)) {
-			rootPosition = NULL;
+		if (!position_from_fen(&context->pos, fen+4)) {
+			validPosition = false;
 			cout << "Error: illegal position: " << fen+4 << endl;
 			return false;
 		}
 	} else if (!strncmp(args, "startpos", 8)) {
-		position_from_fen(rootPosition, STARTING_FEN);
+		position_from_fen(&context->pos, STARTING_FEN);
 	} else {
 		cout << "Error: unrecognized position arguments: " << args << endl;
 		return false;
 	}
 
-	history_new_game();
+	history_new_game(context);
+	validPosition = true;
 	if (moves == NULL)
 		return false;
 
@@ -238,16 +316,111 @@ cmd_position(const char *args)
 			*p++ = *moves++;
 		*p = '\0';
 
-		mv = str2move(rootPosition, move_text);
+		mv = str2move(&context->pos, move_text);
 		if (!mv) {
 			cout << "Error: illegal move: " << move_text << endl;
-			rootPosition = NULL;
+			validPosition = false;
 			return false;
 		}
 
-		make_history_move(rootPosition, mv);
+		make_history_move(context, mv);
+	}
+
+	return true;
+}
+
+///////////////////////////////
+// sets one of the options in uci_options. the value is handed to a
+// string option as it is, and to a spin as an integer.
+///////////////////////////////
+static bool
+cmd_setoption(const char *args)
+{
+	option_t *o;
+	const char *name, *value;
+
+	if (args == NULL || (name = strstr(args, "name ")) == NULL) {
+		cout << "Error: no option name given" << endl;
+		return false;
+	}
+	name += 5;
+
+	if ((value = strstr(name, " value ")) == NULL) {
+		cout << "Error: no value given for option: " << name << endl;
+		return false;
+	}
+
+	for (o = uci_options; o->name; o++)
+		if ((int)strlen(o->name) == value - name && !strncasecmp(name, o->name, value - name))
+			return o->sfunc ? o->sfunc(value + 7) : o->pfunc(atoi(value + 7));
+
+	cout << "Error: unknown option: " << name << endl;
+	return false;
+}
+
+///////////////////////////////
+// reallocates the hash table, in megabytes.
+///////////////////////////////
+static bool
+opt_hash(int mb)
+{
+	if (mb < 1 || mb > 1024)
+		return false;
+	init_hash(mb << 20);
+	return true;
+}
+
+///////////////////////////////
+// reallocates the pawn hash table, in megabytes.
+///////////////////////////////
+static bool
+opt_pawn_hash(int mb)
+{
+	if (mb < 1 || mb > 64)
+		return false;
+	init_pawn_hash(mb << 20);
+	return true;
+}
+
+///////////////////////////////
+// reallocates the eval cache, in megabytes.
+///////////////////////////////
+static bool
+opt_eval_cache(int mb)
+{
+	if (mb < 1 || mb > 256)
+		return false;
+	init_eval_cache(mb << 20);
+	return true;
+}
+
+///////////////////////////////
+// loads the network to evaluate with, or with <empty>, goes back to
+// the classical evaluation.
+///////////////////////////////
+static bool
+opt_eval_file(const char *filename)
+{
+	clear_eval_cache();
+	if (*filename == '\0' || !strcmp(filename, "<empty>")) {
+		unload_network();
+		return true;
 	}
+	if (!load_network(filename))
+		return false;
+	cout << "info string loaded network " << filename << " (" << NNUE_KERNEL << ")" << endl;
+	return true;
+}
 
+///////////////////////////////
+// sets the number of search threads, counting the main one.
+///////////////////////////////
+static bool
+opt_threads(int n)
+{
+	if (n < 1 || n > MAXTHREADS)
+		return false;
+	context->threads = n;
 	return true;
 }
 
@@ -262,31 +435,39 @@ cmd_go(const char *args)
 	int wtime = 0, btime = 0, winc = 0, binc = 0;
 	long nodemax = 0, movetime = 0;
 	int time, inc;
+	search_info_t *info = &context->info;
+	position_t *pos = &context->pos;
 
-	if (rootPosition == NULL) {
+	if (!validPosition) {
 		cout << "Invalid position: can't go." << endl;
 		return false;
 	}
 
+	// the limits of the last go don't carry over
+	info->depthLimit = 0;
+	info->nodeLimit = 0;
+
 	if (args == NULL || strstr(args, "infinite") != NULL)
-		searchInfo->inf = true;
+		info->inf = true;
 	else {
-		searchInfo->inf = false;
+		info->inf = false;
+		get_int_arg(args,  "depth", depthmax);
+		get_long_arg(args, "nodes", nodemax);
+		info->depthLimit = depthmax;
+		info->nodeLimit = nodemax;
+
+		bool clock = get_int_arg(args, "wtime", wtime);
+		clock |= get_int_arg(args, "btime", btime);
+
 		if (get_long_arg(args, "movetime", movetime))
-			searchInfo->endTime = clock() + movetime;
-		else {
-			get_int_arg(args,  "wtime",     wtime);
-			get_int_arg(args,  "btime",     btime);
+			info->endTime = get_time() + movetime;
+		else if (!clock) {
+			// go depth or go nodes alone: there's no clock to run out
+			info->inf = true;
+		} else {
 			get_int_arg(args,  "winc",      winc);
 			get_int_arg(args,  "binc",      binc);
 			get_int_arg(args,  "movestogo", mtg);
-			get_int_arg(args,  "depth",     depthmax);
-			get_long_arg(args, "nodes",     nodemax);
-
-			if (depthmax != 0)
-				searchInfo->depthLimit = depthmax;
-			if (nodemax != 0)
-				searchInfo->nodeLimit = nodemax;
 
 			// found this time calculation in scatha.
 			// much better than what i came up with.
@@ -310,17 +491,23 @@ cmd_go(const char *args)
 					time = time / Min(mtg, 20);
 			}
 
-			searchInfo->endTime = clock() + time;
+			info->endTime = get_time() + time;
 		}
 	}
 
-	move_t move = search(rootPosition);
+	// the gui waits on a bestmove whatever happens. search() only
+	// comes back empty handed when there's no legal move at all, and
+	// then it gets the null move.
+	move_t move = search(context);
 	if (!move) {
-		cout << "Error: Search failed to find a move..." << endl;
+		report_search_stats(context);
+		cout << "bestmove 0000" << endl;
+		cout.flush();
 		return false;
 	}
 
-	make_history_move(rootPosition, move);
+	make_history_move(context, move);
+	report_search_stats(context);
 	cout << "bestmove " << move2str(move) << endl;
 	cout.flush();
 	return true;
@@ -353,7 +540,7 @@ cmd_quit(const char *args)
 static bool
 get_int_arg(const char *line, const char *arg, int &val)
 {
-	char *p = strstr(line, arg);
+	const char *p = strstr(line, arg);
 	if (p == NULL) {
 		val = 0;
 		return false;
@@ -374,7 +561,7 @@ get_int_arg(const char *line, const char *arg, int &val)
 static bool
 get_long_arg(const char *line, const char *arg, long &val)
 {
-	char *p = strstr(line, arg);
+	const char *p = strstr(line, arg);
 	if (p == NULL) {
 		val = 0;
 		return false;
@@ -389,8 +576,11 @@ get_long_arg(const char *line, const char *arg, long &val)
 static bool
 cmd_material(const char *args)
 {
+	position_t *pos = &context->pos;
+
 	cout << "wmaterial = " << Material(0, WHITE) << endl;
 	cout << "bmaterial = " << Material(0, BLACK) << endl;
+	cout << "psq       = " << PsqScore(0, MIDGAME) << " mg, " << PsqScore(0, ENDGAME) << " eg" << endl;
 	return true;
 }
 
@@ -398,7 +588,7 @@ static bool
 cmd_fen(const char *args)
 {
 	char buf[256];
-	strcpy(buf, position_to_fen(rootPosition, 0));
+	strcpy(buf, position_to_fen(&context->pos, 0));
 	cout << buf << endl;
 	return true;
 }
@@ -406,6 +596,6 @@ cmd_fen(const char *args)
 static bool
 cmd_print(const char *args)
 {
-	print_board(rootPosition);
+	print_board(&context->pos);
 	return true;
 }
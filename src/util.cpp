@@ -1,4 +1,19 @@
 #include "benthos.h"
+#include <cstring>
+#include <sys/time.h>
+
+///////////////////////////////
+// returns the wall clock time in milliseconds. the search's time
+// controls used clock(), which counts cpu time (of every thread, at
+// that) in units of CLOCKS_PER_SEC, not milliseconds.
+///////////////////////////////
+uint64
+get_time(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
 
 ///////////////////////////////
 // returns a piece type for a given SAN character.
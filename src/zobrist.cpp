@@ -10,7 +10,7 @@ hashkey_t zobristStm;
 // code elsewhere.
 ///////////////////////////////
 void
-calculate_hash_keys(const position_t *pos, int ply)
+calculate_hash_keys(position_t *pos, int ply)
 {
 	uint8 pc;
 